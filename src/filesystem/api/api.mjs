@@ -6,6 +6,8 @@ export const Filesystem = {};
 export function initialiseAPI(Module) {
   console.log("Initialising filesystem API");
 
+  // Offset (64-bit) arguments are passed as BigInts, the module is built with
+  // WASM_BIGINT
   function callWithErrno(fnName, returnType, argTypes = [], args = []) {
     let sp = Module.stackSave();
 
@@ -88,45 +90,6 @@ export function initialiseAPI(Module) {
       console.error("[JS] Failed to mount filesystem:", err);
     }
 
-    function ifNotExists(path, doit) {
-      if (!M.FS.analyzePath(path, false).exists) {
-        return doit(path);
-      }
-    }
-
-    function moveFilesIn() {
-      console.log("Moving fresh system files in...");
-
-      // Initialise system files
-      let systemFilePath = "/persistent/bin";
-
-      // WARNING: IDBFS requires write access - however users will not be
-      //          able modify regardless due to the PROTECTED_BIT being
-      //          raised signifying it's a system file (0o010)
-      ifNotExists(systemFilePath, (p) => M.FS.mkdir(p, 0o710));
-
-      // Move lua files into correct place in IDBFS
-      for (const luaFile of M.FS.readdir("/luaSource")) {
-        if (luaFile == "." || luaFile == ".." || luaFile == "luaSource") continue;
-
-        let sourcePath = `/luaSource/${luaFile}`;
-        let systemPath = `${systemFilePath}/${luaFile}`;
-
-        // Move files into systemFilePath
-        let data = M.FS.readFile(sourcePath);
-        ifNotExists(systemPath, (p) => {
-          M.FS.writeFile(p, data);
-          // Set correct permissions on file
-          M.FS.chmod(p, 0o710);
-          console.log(`ADDED: ${p}`);
-        });
-      }
-      // Set correct permissions so parent directory cannot be modified either
-      // INFO: I don't believe we're currently using dir permission bits, but future proofing regardless
-      M.FS.chmod(systemFilePath, 0o710);
-    }
-
-
     return new Promise((res, rej) => {
       // Pull in previous data after mounting
       M.FS.syncfs(
@@ -136,7 +99,9 @@ export function initialiseAPI(Module) {
             rej("Failed to syncronize")
           } else {
             console.log("[JS] Sync completed succesfully!");
-            moveFilesIn(res);
+            // Only the system files that changed since the last boot are
+            // written, see bootstrapSystemFiles in post.js
+            M.bootstrapSystemFiles();
             res();
           }
       });
@@ -231,7 +196,7 @@ export function initialiseAPI(Module) {
       "file__read",
       null,
       ["number", "number", "number"],
-      [fd, amt, readResultPtr]
+      [fd, BigInt(amt), readResultPtr]
     );
 
     if (errno > 0) {
@@ -265,6 +230,62 @@ export function initialiseAPI(Module) {
       Module.stackRestore(sp);
     }
   }
+  Filesystem.readAt = (fd, offset, amt) => {
+    let errorStr = null;
+
+    // Read straight into a heap buffer, the fd's cursor isn't touched
+    let dataPtr = Module._malloc(amt);
+
+    try {
+      let { returnVal: size, errno } = callWithErrno(
+        "file__pread",
+        "number",
+        ["number", "number", "number", "number"],
+        [fd, dataPtr, amt, BigInt(offset)]
+      );
+
+      if (errno != 0) {
+        errorStr = errnoToString(errno);
+        return { error: errorStr };
+      }
+
+      const copy = Module.HEAPU8.slice(dataPtr, dataPtr + size);
+      return {
+        error: errorStr,
+        data: Filesystem._UTF8Decoder.decode(copy),
+        size: size
+      }
+    } finally {
+      Module._free(dataPtr);
+    }
+  }
+  Filesystem.writeAt = (fd, offset, content) => {
+    let errorStr = null;
+
+    // Encoded up front so the byte count is known, the heap copy avoids
+    // putting large contents on the stack as ccall's "string" would
+    const bytes = Filesystem._UTF8Encoder.encode(content);
+    let dataPtr = Module._malloc(bytes.length);
+    Module.HEAPU8.set(bytes, dataPtr);
+
+    try {
+      let { returnVal: size, errno } = callWithErrno(
+        "file__pwrite",
+        "number",
+        ["number", "number", "number", "number"],
+        [fd, dataPtr, bytes.length, BigInt(offset)]
+      );
+
+      if (errno != 0) {
+        errorStr = errnoToString(errno);
+        return { error: errorStr };
+      }
+
+      return { error: errorStr, size };
+    } finally {
+      Module._free(dataPtr);
+    }
+  }
   Filesystem.readAll = (fd) => {
     let errorStr = null;
 
@@ -316,7 +337,7 @@ export function initialiseAPI(Module) {
       "file__shift",
       null,
       ["number", "number"],
-      [fd, amt]
+      [fd, BigInt(amt)]
     );
 
     if (errno > 0) {
@@ -332,7 +353,7 @@ export function initialiseAPI(Module) {
       "file__goto",
       null,
       ["number", "number"],
-      [fd, pos]
+      [fd, BigInt(pos)]
     );
 
     if (errno > 0) {
@@ -341,6 +362,31 @@ export function initialiseAPI(Module) {
 
     return { error: errorStr }
   };
+  Filesystem.replaceContents = (path, content) => {
+    let errorStr = null;
+
+    // Contents go through the heap rather than the ccall stack, as writeAt
+    const bytes = Filesystem._UTF8Encoder.encode(content);
+    let dataPtr = Module._malloc(bytes.length);
+    Module.HEAPU8.set(bytes, dataPtr);
+
+    try {
+      let { errno } = callWithErrno(
+        "file__replace_contents",
+        null,
+        ["string", "number", "number"],
+        [path, dataPtr, bytes.length]
+      );
+
+      if (errno != 0) {
+        errorStr = errnoToString(errno);
+      }
+
+      return { error: errorStr };
+    } finally {
+      Module._free(dataPtr);
+    }
+  }
   Filesystem.remove = (path) => {
     let errorStr = null;
 
@@ -427,10 +473,46 @@ export function initialiseAPI(Module) {
     let entryPtr = derefs(view);
     while (entryPtr !== 0) {
       entries.push(Module.UTF8ToString(entryPtr));
-      Module._free(entryPtr);
       i++;
       entryPtr = derefs(view + i * 4);
     }
+    // The names live in the same block as the array
+    Module._free(returnVal);
+
+    return { error: errorStr, entries }
+  }
+  Filesystem.read_dir_plus = (path) => {
+    let errorStr = null;
+
+    const { returnVal, errno } = callWithErrno(
+      "file__read_dir_plus",
+      "number",
+      ["string"],
+      [path]
+    );
+
+    if (errno != 0) {
+      errorStr = errnoToString(errno);
+      return { error: errorStr, entries: null };
+    }
+
+    // Names and stat records share one allocation, freed once at the end
+    const listing = new StructView(Module, "DirListing", returnVal);
+    const count = listing.count;
+    const statsPtr = listing.stats;
+    const namesPtr = listing.names;
+    const statSize = sizeof(Module, "StatResult");
+
+    let entries = [];
+    for (let i = 0; i < count; i++) {
+      const statPtr = statsPtr + i * statSize;
+      // Entries that couldn't be stat'ed come back with a type of -1
+      const statable = new StructView(Module, "StatResult", statPtr).type !== -1;
+      entries.push({
+        name: Module.UTF8ToString(Module.getValue(namesPtr + i * 4, '*')),
+        stat: statable ? extractStatFields(statPtr) : null,
+      });
+    }
     Module._free(returnVal);
 
     return { error: errorStr, entries }
@@ -543,7 +625,19 @@ export function initialiseAPI(Module) {
       "file__truncate",
       null,
       ["number", "number"],
-      [fd, length],
+      [fd, BigInt(length)],
+    );
+    if (errno > 0) {
+      return { error: errnoToString(errno) };
+    }
+    return { error: null };
+  }
+  Filesystem.reserve = (fd, size) => {
+    let { errno } = callWithErrno(
+      "file__reserve",
+      null,
+      ["number", "number"],
+      [fd, BigInt(size)],
     );
     if (errno > 0) {
       return { error: errnoToString(errno) };
@@ -75,6 +75,21 @@ end
 -- Core
 -- ===================================================
 
+-- Handles a single line, without its newline
+function cat_line(line, newline, opts, state)
+  -- Visualisation options
+  if opts.show_tabs then line = line:gsub("\t", "^I") end
+  if opts.show_ends then line = line .. "$" end
+
+  -- Numbering
+  if opts.number then
+    line = string.format("%6d\t%s", state.line_number, line)
+    state.line_number = state.line_number + 1
+  end
+
+  output(line .. newline, { newline = false })
+end
+
 -- Handles lines of text
 function cat_text(txt, opts, state)
   for segment in txt:gmatch("([^\n]*\n?)") do
@@ -85,19 +100,32 @@ function cat_text(txt, opts, state)
         newline = "\n"
         line = line:sub(1, -2)
       end
+      cat_line(line, newline, opts, state)
+    end
+  end
+end
 
-      -- Visualisation options
-      if opts.show_tabs then line = line:gsub("\t", "^I") end
-      if opts.show_ends then line = line .. "$" end
-
-      -- Numbering
-      if opts.number then
-        line = string.format("%6d\t%s", state.line_number, line)
-        state.line_number = state.line_number + 1
-      end
+-- Most written out at once when a file is passed through untouched
+local CHUNK_SIZE = 64 * 1024
 
-      output(line .. newline, { newline = false })
+-- Handles a mapped file, without reading it into one big string
+function cat_map(map, opts, state)
+  if not (opts.number or opts.show_ends or opts.show_tabs) then
+    for i = 1, #map, CHUNK_SIZE do
+      output(map:sub(i, i + CHUNK_SIZE - 1), { newline = false })
     end
+    return
+  end
+
+  -- Lines come without newlines, so hold each back until it's known
+  -- whether it's the last (which may not have had one)
+  local pending = nil
+  for line in map:lines() do
+    if pending then cat_line(pending, "\n", opts, state) end
+    pending = line
+  end
+  if pending then
+    cat_line(pending, map:sub(-1) == "\n" and "\n" or "", opts, state)
   end
 end
 
@@ -118,19 +146,14 @@ function cat_file(path, opts, state)
     return
   end
 
-  local fd, err = file.open(path, "r")
-  if err or not fd then
+  local map, err = file.map(path)
+  if err or not map then
     report_error(path, err)
     return
   end
 
-  local txt, rerr = file.read_all(fd)
-  if rerr then
-    report_error(path, rerr)
-  else
-    cat_text(txt or "", opts, state)
-  end
-  file.close(fd)
+  cat_map(map, opts, state)
+  map:close()
 end
 
 -- ===================================================
@@ -123,50 +123,13 @@ function copy_file(src, dst, opts, err_flag)
     end
   end
 
-  -- open source
-  local infd, inerr = file.open(src, "r")
-  if inerr then
-    report_error(src, dst, inerr)
+  -- Streamed natively, the contents never pass through lua
+  local cerr = file.copy(src, dst)
+  if cerr then
+    report_error(src, dst, cerr)
     err_flag[1] = true
     return
   end
-
-  -- Delete destination if it exists
-  if dst_st then
-    local remerr = file.remove(dst)
-    if remerr then
-      report_error(src, dst, remerr)
-      err_flag[1] = true
-      return
-    end
-  end
-
-  -- open destination
-  local outfd, outerr = file.open(dst, "wc")
-  if outerr then
-    report_error(src, dst, outerr)
-    err_flag[1] = true
-    return
-  end
-
-  -- read source
-  local content, readerr = file.read_all(infd)
-  if readerr then
-    report_error(src, dst, readerr)
-    err_flag[1] = true
-    return
-  end
-
-  -- write read content to destination
-  local writerr = file.write(outfd, content)
-  if writerr then
-    report_error(src, dst, readerr)
-    err_flag[1] = true
-    return
-  end
-
-  file.close(infd)
-  file.close(outfd)
 end
 
 function copy_path(src, dst, opts, err_flag)
@@ -190,6 +153,16 @@ function copy_path(src, dst, opts, err_flag)
       return
     end
 
+    -- Nothing to ask about per file, so copy the whole tree natively
+    if not opts.interactive and not opts.no_clobber then
+      local terr = file.copy_tree(src, dst)
+      if terr then
+        report_error(src, dst, terr)
+        err_flag[1] = true
+      end
+      return
+    end
+
     -- make destination directory if needed
     if not dst_st then
       local merr = file.make_dir(dst)
@@ -289,15 +289,6 @@ for _, fname in pairs(positional) do
   end
 end
 
-local function filter_rel(entries)
-  for i = #entries, 1, -1 do -- so we can in place remove items
-    local entry = entries[i]
-    if entry == "." or entry == ".." then
-      table.remove(entries, i)
-    end
-  end
-end
-
 local function basename(path)
   return path:match("[^/]*$")
 end
@@ -384,44 +375,39 @@ local function action(depth, stat, path)
   return true
 end
 
-local function find(depth, parent, files_or_dirs)
+-- Where a PATH argument starts, relative to the CWD
+local function root_path(cwd, fname)
+  if fname == "." then
+    return cwd
+  end
+  if fname:sub(1, 1) == "/" then
+    return fname
+  end
+  if cwd == "/" then
+    return "/" .. fname
+  end
+  return cwd .. "/" .. fname
+end
+
+-- The tree is walked in C, nodes that can't be read are reported and skipped
+local function find(root)
   local match = false
-  if config.max_depth and depth > config.max_depth then
+  if config.max_depth and config.max_depth < 0 then
     return match
   end
-  for _, fname in ipairs(files_or_dirs) do
-    local full_path
-
-    if parent == "/" and fname ~= "." then
-      parent = ""
-    end
 
-    if fname ~= "/" then
-      full_path = parent .. "/" .. fname
-    else
-      full_path = "/"
-    end
-
-    if fname == "." then
-      full_path = parent
-    end
-
-    local stat, err = file.stat(full_path)
+  local opts = { max_depth = config.max_depth and math.floor(config.max_depth) }
+  local iter, state, control, closing = file.walk(root, opts)
+  if iter == nil then
+    error(root, errors.as_string(state))
+    return match
+  end
+  for path, stat, depth, err in iter, state, control, closing do
     if err ~= nil then
-      error(full_path, errors.as_string(err))
-    else
-      if stat.type == DIRECTORY then
-        local entries, err = file.read_dir(full_path)
-        if err ~= nil then
-          error(full_path, errors.as_string(err))
-        else
-          filter_rel(entries)
-          match = action(depth, stat, full_path) or match
-          match = find(depth + 1, full_path, entries) or match
-        end
-      else
-        match = action(depth, stat, full_path) or match
-      end
+      error(path, errors.as_string(err))
+    end
+    if stat ~= nil then
+      match = action(depth, stat, path) or match
     end
   end
   return match
@@ -430,7 +416,12 @@ end
 local cwd, err = file.cwd()
 errors.ok(err)
 
-if find(0, cwd, positional) then
+local match = false
+for _, fname in ipairs(positional) do
+  match = find(root_path(cwd, fname)) or match
+end
+
+if match then
   process.exit(0)
 else
   process.exit(1)
@@ -266,70 +266,76 @@ local function grep_line(ctx, line)
     line = line:lower()
   end
 
-  for i, pat in ipairs(config.patterns) do
+  local match = nil
+  for _, pat in ipairs(config.patterns) do
     if config.ignore_case then
       pat = pat:lower()
     end
-    local match = string.match(line, pat)
-    if match then
-      ctx.match = match
-      if config.name_only == 0 then
-        grep_output(ctx, orig_line)
-      end
-      return true
-    end
-    if config.invert then
-      if config.name_only == 0 then
-        grep_output(ctx, orig_line)
-      end
-      return true
+    local s, e = string.find(line, pat)
+    if s then
+      match = orig_line:sub(s, e)
+      break
     end
   end
-  return false
+  if (match ~= nil) == config.invert then
+    return false
+  end
+  ctx.match = match or orig_line
+  if config.name_only == 0 then
+    grep_output(ctx, orig_line)
+  end
+  return true
 end
 
-local function grep_text(ctx, text)
+local function report_name(ctx, match)
+  if not match and config.name_only == FILES_NOMATCH then
+    output(ctx.file_name)
+  end
+  if match and config.name_only == FILES_MATCH then
+    output(ctx.file_name)
+  end
+end
+
+local function grep_lines(ctx, lines)
   local match = false
   ctx.line_no = 1
-  for line in text:gmatch('[^\n]*') do
+  for line in lines do
     if grep_line(ctx, line) then
       match = true
     end
     ctx.line_no = ctx.line_no + 1
   end
-  if not match and config.name_only == FILES_NOMATCH then
-    output(ctx.file_name)
-  end
-  if match and config.name_only == FILES_MATCH then
-    output(ctx.file_name)
-  end
+  report_name(ctx, match)
   return match
 end
 
 local function grep_file(file_name)
-  local fd, err = file.open(file_name, "r")
-  if err ~= nil then
-    error_if(file, errors.as_string(err), not config.suppress)
-    return false
-  end
-  local data, err = file.read_all(fd)
+  -- Searched natively over the whole file, Lua only sees the lines that are printed
+  local scan, err = search.scan(file_name, config.patterns, {
+    ignore_case = config.ignore_case,
+    invert = config.invert,
+    -- Past the first match only the file's name matters
+    max_count = (config.quiet or config.name_only ~= 0) and 1 or nil,
+  })
   if err ~= nil then
-    error_if(file, errors.as_string(err), not config.suppress)
-    file.close(fd)
+    error_if(file_name, errors.as_string(err), not config.suppress)
     return false
   end
-  file.close(fd)
-  return grep_text({ file_name = file_name }, data)
-end
-
--- Filter relative directory entries i.e.: ".", ".."
-local function filter_rel(entries)
-  for i = #entries, 1, -1 do -- so we can in place remove items
-    local entry = entries[i]
-    if entry == "." or entry == ".." then
-      table.remove(entries, i)
+  local ctx = { file_name = file_name }
+  local match = false
+  for batch in scan:batches() do
+    match = true
+    if config.name_only == 0 then
+      for i = 1, #batch, 3 do
+        ctx.line_no = batch[i]
+        ctx.match = scan:sub(batch[i + 1], batch[i + 2])
+        grep_output(ctx, scan:line(batch[i + 1]))
+      end
     end
   end
+  scan:close()
+  report_name(ctx, match)
+  return match
 end
 
 local function grep(parent, files_or_dirs)
@@ -340,7 +346,7 @@ local function grep(parent, files_or_dirs)
       if err ~= nil then
         error_if("(standard input)", errors.as_string(err), not config.suppress)
       else
-        match = grep_text({ file_name = "(standard input)" }, text) or match
+        match = grep_lines({ file_name = "(standard input)" }, text:gmatch('[^\n]*')) or match
       end
     else
       local full_path
@@ -349,20 +355,18 @@ local function grep(parent, files_or_dirs)
       else
         full_path = "/" .. fname
       end
-      local stat, err = file.stat(full_path)
-      if err ~= nil then
-        error_if(full_path, errors.as_string(err), not config.suppress)
+      -- Directories are walked in C, nodes that can't be read are reported
+      -- and skipped
+      local iter, state, control, closing = file.walk(full_path, { type = FILE })
+      if iter == nil then
+        error_if(full_path, errors.as_string(state), not config.suppress)
       else
-        if stat.type == DIRECTORY then
-          local entries, err = file.read_dir(full_path)
+        for path, stat, _, err in iter, state, control, closing do
           if err ~= nil then
-            error_if(full_path, errors.as_string(err), not config.supress)
+            error_if(path, errors.as_string(err), not config.suppress)
           else
-            filter_rel(entries)
-            match = grep(full_path, entries) or match
+            match = grep_file(path) or match
           end
-        else
-          match = grep_file(full_path) or match
         end
       end
     end
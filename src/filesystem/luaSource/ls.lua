@@ -256,7 +256,7 @@ end
 -- ===================================================
 
 function list_dir(path, opts, label_paths, first_call)
-  local entries, err = file.read_dir(path)
+  local entries, err = file.read_dir(path, { stat = true })
   if err then
     output(string.format("ls: cannot access '%s': %s", path, errors.as_string(err) or ("error" .. tostring(err))))
     return
@@ -270,13 +270,12 @@ function list_dir(path, opts, label_paths, first_call)
 
   -- Build the list
   local list = {}
-  for _, name in ipairs(entries) do
-    if opts.all or (opts.almost_all and not (name == "." or name == "..")) or (name:sub(1,1) ~= ".") then
-      local full = join(path, name)
-      local st, st_err = file.stat(full)
-      if not st_err then
-        table.insert(list, { name = name, full = full, stat = st })
-      end
+  for _, entry in ipairs(entries) do
+    local name = entry.name
+    -- Entries that couldn't be stat'ed (e.g. removed meanwhile) are skipped
+    if entry.stat and (opts.all or (opts.almost_all and not (name == "." or name == "..")) or (name:sub(1,1) ~= ".")) then
+      entry.full = join(path, name)
+      table.insert(list, entry)
     end
   end
 
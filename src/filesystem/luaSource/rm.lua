@@ -123,6 +123,13 @@ function remove_path(path, opts, top_level)
       return
     end
 
+    -- Nothing to ask about per entry, so remove the whole tree natively
+    if not opts.interactive then
+      local terr = file.remove_tree(path)
+      if terr and not opts.force then report_error(path, terr) end
+      return
+    end
+
     -- First remove all contents
     local entries, derr = file.read_dir(path)
     if derr then
@@ -33,7 +33,14 @@ end
 local env_table = {
   PATH = "/bin",
   HOME = "/",
-  PROMPT = "$ "
+  PROMPT = "$ ",
+  -- Capacity of the pipes between commands, which start at PIPE_SIZE and
+  -- grow up to PIPE_MAX while a producer keeps filling them
+  PIPE_SIZE = "16384",
+  PIPE_MAX = "1048576",
+  -- Set to "1" to keep each command's output pipe in its own memory, which
+  -- stays at PIPE_SIZE
+  HEAP_PIPE = "0"
 }
 
 function set_env_var(key, value)
@@ -119,6 +126,15 @@ end
 -- ####### Utils #######
 -- #####################
 
+-- Reads a pipe capacity from the environment, nil if it isn't an integer of
+-- at least 2 (a pipe keeps one byte free) or is below `min`
+function pipe_size_var(key, min)
+  local size = math.tointeger(tonumber(get_env_var(key)))
+  if size and size >= 2 and size >= (min or 0) then
+    return size
+  end
+end
+
 -- Searches the PATH for command, returns path | nil
 function find_exec_file(name)
 
@@ -935,7 +951,10 @@ function exec_pipeline(pipeline_ast, ctx)
         pipe_in = pipe_in,
         pipe_out = pipe_out,
         redirect_in = simple_cmd.redirect_in,
-        redirect_out = simple_cmd.redirect_out
+        redirect_out = simple_cmd.redirect_out,
+        pipe_size = pipe_size_var("PIPE_SIZE"),
+        pipe_max = pipe_size_var("PIPE_MAX", pipe_size_var("PIPE_SIZE")),
+        heap_pipe = get_env_var("HEAP_PIPE") == "1"
       })
 
       if err then
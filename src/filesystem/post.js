@@ -7,3 +7,91 @@ if (!ENVIRONMENT_IS_NODE) {
     return syncfsOld(mount, populate, callback);
   }
 }
+
+// FNV-1a, only used to tell whether a system file changed between builds
+function hashSystemFile(bytes) {
+  let hash = 0x811c9dc5;
+  for (let i = 0; i < bytes.length; i++) {
+    hash ^= bytes[i];
+    hash = Math.imul(hash, 0x01000193);
+  }
+  return hash >>> 0;
+}
+
+// Copies the Lua programs embedded at /luaSource into /persistent/bin. A
+// manifest of each file's size and hash is kept beside them, so a file that
+// hasn't changed since the last boot is neither looked up nor written again
+// (and IDBFS has nothing to persist), while changed ones are replaced
+function bootstrapSystemFiles() {
+  const started = performance.now();
+  const sourcePath = "/luaSource";
+  const systemFilePath = "/persistent/bin";
+  const manifestPath = `${systemFilePath}/.manifest.json`;
+
+  // WARNING: IDBFS requires write access - however users will not be
+  //          able modify regardless due to the PROTECTED_BIT being
+  //          raised signifying it's a system file (0o010)
+  if (!FS.analyzePath(systemFilePath, false).exists) {
+    FS.mkdir(systemFilePath, 0o710);
+  }
+
+  let previous = null;
+  try {
+    previous = JSON.parse(FS.readFile(manifestPath, { encoding: "utf8" }));
+  } catch {
+    // First boot, or from before there was a manifest: write everything
+  }
+
+  // What's actually there, as a manifest entry alone can't tell a file has
+  // since gone missing from IDBFS
+  const present = new Set(FS.readdir(systemFilePath));
+
+  const manifest = {};
+  let written = 0;
+  let unchanged = 0;
+  for (const name of FS.readdir(sourcePath)) {
+    const path = `${sourcePath}/${name}`;
+    if (!FS.isFile(FS.stat(path).mode)) continue;
+
+    const data = FS.readFile(path);
+    const entry = { size: data.length, hash: hashSystemFile(data) };
+    manifest[name] = entry;
+
+    const old = previous && Object.hasOwn(previous, name) ? previous[name] : null;
+    if (old && old.size == entry.size && old.hash == entry.hash && present.has(name)) {
+      unchanged++;
+      continue;
+    }
+
+    const systemPath = `${systemFilePath}/${name}`;
+    FS.writeFile(systemPath, data);
+    // Set correct permissions on file
+    FS.chmod(systemPath, 0o710);
+    written++;
+  }
+
+  // Programs an older build shipped and this one doesn't
+  let removed = 0;
+  for (const name of Object.keys(previous ?? {})) {
+    if (Object.hasOwn(manifest, name)) continue;
+    try {
+      FS.unlink(`${systemFilePath}/${name}`);
+      removed++;
+    } catch {
+      // Already gone
+    }
+  }
+
+  if (previous === null || written > 0 || removed > 0) {
+    FS.writeFile(manifestPath, JSON.stringify(manifest));
+    FS.chmod(manifestPath, 0o710);
+  }
+  // Set correct permissions so parent directory cannot be modified either
+  // INFO: I don't believe we're currently using dir permission bits, but future proofing regardless
+  FS.chmod(systemFilePath, 0o710);
+
+  const elapsed = (performance.now() - started).toFixed(1);
+  console.log(`Bootstrapped ${systemFilePath}: ${written} written, ${unchanged} unchanged, ${removed} removed in ${elapsed} ms`);
+  return { written, unchanged, removed };
+}
+Module["bootstrapSystemFiles"] = bootstrapSystemFiles;
@@ -1,8 +1,11 @@
+#define _GNU_SOURCE // fallocate
 #include <dirent.h>
 #include <unistd.h>
 #define FILE_IMPL
 #include "file.h"
+#include "scan.h"
 #include <stdio.h>
+#include <time.h>
 
 // Emscripten uses its own errno convention when compiled which
 // makes accurate error reporting convoluted - use our own.
@@ -53,6 +56,197 @@ bool is_system_file(struct stat *node_stat) {
   return (node_stat->st_mode & PROTECTED_BIT) == PROTECTED_BIT;
 }
 
+// Read-ahead state kept by file__read_line for an open file. Blocks of
+// CHUNK_SIZE are read in and lines are served out of them, so reading a file
+// line by line costs one read per block rather than one per line
+typedef struct {
+  char *data; // NULL when the fd has no read-ahead
+  int start;  // first byte not yet handed out
+  int end;    // one past the last byte read in
+  bool eof;
+} LineBuffer;
+
+// Indexed by fd, grown on demand
+static LineBuffer *line_buffers = NULL;
+static int line_buffers_cap = 0;
+
+static LineBuffer *line_buffer__get(int fd, Error *err) {
+  if (fd < 0) {
+    *err = E_INVALID;
+    return NULL;
+  }
+
+  if (fd >= line_buffers_cap) {
+    int cap = line_buffers_cap ? line_buffers_cap : 16;
+    while (cap <= fd) cap *= 2;
+    LineBuffer *grown = realloc(line_buffers, cap * sizeof(LineBuffer));
+    if (!grown) {
+      *err = translate_errors(errno);
+      return NULL;
+    }
+    memset(grown + line_buffers_cap, 0, (cap - line_buffers_cap) * sizeof(LineBuffer));
+    line_buffers = grown;
+    line_buffers_cap = cap;
+  }
+
+  LineBuffer *lb = &line_buffers[fd];
+  if (!lb->data) {
+    lb->data = malloc(CHUNK_SIZE);
+    if (!lb->data) {
+      *err = translate_errors(errno);
+      return NULL;
+    }
+    lb->start = lb->end = 0;
+    lb->eof = false;
+  }
+
+  *err = 0;
+  return lb;
+}
+
+// Drops any read-ahead for `fd`, first seeking back over the bytes that were
+// read in but never handed out so the offset is where the caller expects it.
+// Anything else that reads, writes or moves the offset must call this first
+static void line_buffer__sync(int fd) {
+  if (fd < 0 || fd >= line_buffers_cap || !line_buffers[fd].data) return;
+
+  LineBuffer *lb = &line_buffers[fd];
+  if (lb->end > lb->start) lseek(fd, lb->start - lb->end, SEEK_CUR);
+  free(lb->data);
+  lb->data = NULL;
+}
+
+// ======================= Metadata cache =======================
+
+// file__stat results by absolute path, so listing a directory and then
+// stat'ing what's in it, or stat'ing the same nodes over and over, doesn't
+// walk the tree each time. Anything in this process that changes the tree
+// or a file moves the generation on, dropping every entry at once
+typedef struct {
+  unsigned long generation; // only live while this is the current one
+  unsigned long last_used;
+  uint32_t hash;
+  double expires; // monotonic ms
+  char path[METADATA_CACHE_PATH_MAX];
+  StatResult stat;
+} MetadataCacheEntry;
+
+// Entries a path may land in, the least recently used is evicted
+#define METADATA_CACHE_WAYS 4
+
+static MetadataCacheEntry metadata_cache[METADATA_CACHE_SIZE];
+static unsigned long metadata_cache_generation = 1;
+static unsigned long metadata_cache_tick = 0;
+static MetadataCacheStats metadata_cache_counters = {0};
+
+// Marks fds file__open handed out for regular files. Writing through
+// anything else (the terminal, pipes) changes no stat worth dropping the
+// cache for, fds past the end are assumed to be files
+#define TRACKED_FDS 1024
+static uint32_t file_fds[TRACKED_FDS / 32];
+
+static void fd_track(int fd, bool is_file) {
+  if (fd < 0 || fd >= TRACKED_FDS) return;
+  if (is_file) file_fds[fd / 32] |= 1u << (fd % 32);
+  else file_fds[fd / 32] &= ~(1u << (fd % 32));
+}
+
+static double monotonic_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// FNV-1a
+static uint32_t hash_path(const char *path, size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)path[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static MetadataCacheEntry *metadata_cache__ways(uint32_t hash) {
+  return &metadata_cache[(hash % (METADATA_CACHE_SIZE / METADATA_CACHE_WAYS)) * METADATA_CACHE_WAYS];
+}
+
+static bool metadata_cache__live(const MetadataCacheEntry *entry, double now) {
+  return entry->generation == metadata_cache_generation && entry->expires > now;
+}
+
+static void metadata_cache__invalidate(void) {
+  metadata_cache_generation++;
+  metadata_cache_counters.invalidations++;
+}
+
+// For changes made through an fd, which can't be tied back to a path
+static void metadata_cache__invalidate_fd(int fd) {
+  if (fd >= 0 && fd < TRACKED_FDS && !(file_fds[fd / 32] & (1u << (fd % 32)))) return;
+  metadata_cache__invalidate();
+}
+
+static bool metadata_cache__get(const char *path, StatResult *sr) {
+  // Relative paths depend on the CWD, so aren't worth keying on
+  size_t len = strlen(path);
+  if (path[0] != '/' || len >= METADATA_CACHE_PATH_MAX) return false;
+
+  uint32_t hash = hash_path(path, len);
+  MetadataCacheEntry *ways = metadata_cache__ways(hash);
+  double now = monotonic_ms();
+  for (int i = 0; i < METADATA_CACHE_WAYS; i++) {
+    MetadataCacheEntry *entry = &ways[i];
+    if (entry->hash == hash && metadata_cache__live(entry, now) && strcmp(entry->path, path) == 0) {
+      entry->last_used = ++metadata_cache_tick;
+      *sr = entry->stat;
+      metadata_cache_counters.hits++;
+      return true;
+    }
+  }
+  metadata_cache_counters.misses++;
+  return false;
+}
+
+static void metadata_cache__put(const char *path, size_t len, const StatResult *sr) {
+  if (path[0] != '/' || len >= METADATA_CACHE_PATH_MAX) return;
+
+  uint32_t hash = hash_path(path, len);
+  MetadataCacheEntry *ways = metadata_cache__ways(hash);
+  double now = monotonic_ms();
+  // The path's own entry if it has one, otherwise a dead one, otherwise
+  // the least recently used
+  MetadataCacheEntry *victim = NULL;
+  for (int i = 0; i < METADATA_CACHE_WAYS; i++) {
+    MetadataCacheEntry *entry = &ways[i];
+    if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+      victim = entry;
+      break;
+    }
+    if (!metadata_cache__live(entry, now)) {
+      if (victim == NULL || metadata_cache__live(victim, now)) victim = entry;
+    } else if (victim == NULL || (metadata_cache__live(victim, now) && entry->last_used < victim->last_used)) {
+      victim = entry;
+    }
+  }
+
+  victim->generation = metadata_cache_generation;
+  victim->last_used = ++metadata_cache_tick;
+  victim->hash = hash;
+  victim->expires = now + METADATA_CACHE_TTL_MS;
+  memcpy(victim->path, path, len + 1);
+  victim->stat = *sr;
+}
+
+void file__cache_stats(MetadataCacheStats *stats) {
+  *stats = metadata_cache_counters;
+  stats->capacity = METADATA_CACHE_SIZE;
+  stats->entries = 0;
+  double now = monotonic_ms();
+  for (int i = 0; i < METADATA_CACHE_SIZE; i++) {
+    if (metadata_cache__live(&metadata_cache[i], now)) stats->entries++;
+  }
+}
+
 // Explicitly forces a filesystem synchronisation.
 // Likely not needed if the IDBFS filesystem is mounted with `autoPersist`
 // option set to TRUE
@@ -103,97 +297,83 @@ void file__initialiseFSNode() {
         let persistentRoot = UTF8ToString($0);
         FS.mkdir(persistentRoot);
 
-        console.log("Moving fresh system files in...");
-
-        // Initialise system files
-        let systemFilePath = "/persistent/bin";
-
-        // WARNING: IDBFS requires write access - however users will not be
-        //          able modify regardless due to the PROTECTED_BIT being
-        //          raised signifying it's a system file (0o010)
-        FS.mkdir(systemFilePath, 0o710);
-
-        // Move lua files into correct place in IDBFS
-        for (const luaFile of FS.readdir("/luaSource")) {
-          if (luaFile == "." || luaFile == "..") continue;
-
-          let sourcePath = `/luaSource/${luaFile}`;
-          let systemPath = `${systemFilePath}/${luaFile}`;
-
-          // Move files into systemFilePath
-          let data = FS.readFile(sourcePath);
-          FS.writeFile(systemPath, data);
-
-          // Set correct permissions on file
-          FS.chmod(systemPath, 0o710);
-
-          console.log(`ADDED: ${systemPath}`);
-        }
-        // Set correct permissions so parent directory cannot be modified either
-        // INFO: I don't believe we're currently using dir permission bits, but future proofing regardless
-        FS.chmod(systemFilePath, 0o710);
-
-        console.log("Finished bootstrap");
-
+        // Defined in post.js, shared with the browser's initialiseFS
+        bootstrapSystemFiles();
       },
       PERSISTENT_ROOT_NAME);
 #endif
 }
 
 int file__open(const char *restrict path, int flags, Error *restrict err) {
-  // Permission checks
-  struct stat st = {0};
-  bool file_exists = (stat(path, &st) == 0);
-
   bool wants_read =
       ((flags & O_RDONLY) == O_RDONLY) || ((flags & O_RDWR) == O_RDWR);
   bool wants_write =
       ((flags & O_WRONLY) == O_WRONLY) || ((flags & O_RDWR) == O_RDWR);
 
-  if (file_exists) {
-    // If the file already exists, and the user specified "create", fail
-    if ((flags & O_CREAT) == O_CREAT) {
-      *err = E_EXISTS;
-      return -1;
-    }
-    // Read check
-    if (wants_read && !can_read(&st)) {
-      *err = translate_errors(EACCES);
-      return -1;
-    }
-    // Write check
-    if (wants_write && !can_write(&st)) {
-      *err = translate_errors(EACCES);
-      return -1;
-    }
-    // Trying to write to system file check
-    if (wants_write && is_system_file(&st)) {
-      *err = translate_errors(EROFS);
-      return -1;
-    }
-  } else {
-    // The file doesn't exist
-    if ((flags & O_CREAT) == 0) {
-      *err = translate_errors(ENOENT);
+  // Creating only ever succeeds on a node that didn't exist, so there's
+  // nothing to check once it has
+  if ((flags & O_CREAT) == O_CREAT) {
+    int fd = open(path, flags | O_EXCL, 0700);
+    if (fd < 0) {
+      *err = translate_errors(errno);
       return -1;
     }
+    metadata_cache__invalidate();
+    fd_track(fd, true);
+    *err = 0;
+    return fd;
   }
 
-  // Finally open the file
-  int fd = open(path, flags, 0700);
-
+  // Otherwise open first and check permissions on what was opened, holding
+  // back truncation until the checks pass
+  int fd = open(path, flags & ~O_TRUNC);
   if (fd < 0) {
-    // has failed (sad) :'(
     *err = translate_errors(errno);
     return -1;
   }
 
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    *err = translate_errors(errno);
+    goto reject;
+  }
+  // Read check
+  if (wants_read && !can_read(&st)) {
+    *err = translate_errors(EACCES);
+    goto reject;
+  }
+  // Write check
+  if (wants_write && !can_write(&st)) {
+    *err = translate_errors(EACCES);
+    goto reject;
+  }
+  // Trying to write to system file check
+  if (wants_write && is_system_file(&st)) {
+    *err = translate_errors(EROFS);
+    goto reject;
+  }
+
+  if ((flags & O_TRUNC) == O_TRUNC) {
+    metadata_cache__invalidate();
+    if (ftruncate(fd, 0) < 0) {
+      *err = translate_errors(errno);
+      goto reject;
+    }
+  }
+
+  fd_track(fd, S_ISREG(st.st_mode));
   *err = 0;
   return fd;
+
+reject:
+  close(fd);
+  return -1;
 }
 
 void file__close(int fd, Error *err) {
   // NOTE: no perm checks, as they wouldn't make sense here
+  line_buffer__sync(fd);
+  fd_track(fd, false);
   if (close(fd) < 0) {
     *err = translate_errors(errno);
     return;
@@ -203,25 +383,90 @@ void file__close(int fd, Error *err) {
 }
 
 void file__write(int fd, const char *restrict content, Error *restrict err) {
+  file__write_n(fd, content, strlen(content), err);
+}
+
+void file__write_n(int fd, const char *restrict buf, int len, Error *restrict err) {
   // NOTE: no perm checks as the user already has the file descriptor
+  line_buffer__sync(fd);
+  metadata_cache__invalidate_fd(fd);
+
+  // A write may be short, keep going until all of it is out
+  while (len > 0) {
+    ssize_t written = write(fd, buf, len);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      *err = translate_errors(errno);
+      return;
+    }
+    buf += written;
+    len -= written;
+  }
+  *err = 0;
+  return;
+}
 
-  int contentLength = strlen(content);
-  int written = write(fd, content, contentLength);
-  if (written < 0) {
-    *err = translate_errors(errno);
-    return;
+void file__writev(int fd, const WriteSlice *restrict slices, int count, Error *restrict err) {
+  // NOTE: no perm checks as the user already has the file descriptor
+  line_buffer__sync(fd);
+  metadata_cache__invalidate_fd(fd);
+
+  struct iovec iov[WRITEV_BATCH];
+  int next = 0;
+  while (next < count) {
+    // Gather as many slices as fit in one call
+    int n = 0;
+    for (; n < WRITEV_BATCH && next + n < count; n++) {
+      iov[n].iov_base = (void *)slices[next + n].data;
+      iov[n].iov_len = slices[next + n].size;
+    }
+    next += n;
+
+    // Then flush them, picking up from wherever a short write left off
+    struct iovec *at = iov;
+    while (n > 0) {
+      ssize_t written = writev(fd, at, n);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        *err = translate_errors(errno);
+        return;
+      }
+      while (n > 0 && (size_t)written >= at->iov_len) {
+        written -= at->iov_len;
+        at++;
+        n--;
+      }
+      if (n > 0) {
+        at->iov_base = (char *)at->iov_base + written;
+        at->iov_len -= written;
+      }
+    }
   }
   *err = 0;
   return;
 }
 
 // Reads up to `amt`, returning whatever it was able to read
-void file__read(int fd, int amt, ReadResult *restrict rr, Error *restrict err) {
+void file__read(int fd, Offset amt, ReadResult *restrict rr, Error *restrict err) {
   // NOTE: No permission checks here - they already obtained fd
+  line_buffer__sync(fd);
 
   rr->size = -1;
   rr->data = NULL;
 
+  // The buffer is only as big as what's left to read, and a single read
+  // never returns more than fits in rr->size anyway
+  Offset remaining = file__remaining(fd);
+  if (remaining >= 0 && amt > remaining) amt = remaining;
+  if (amt > INT_MAX) amt = INT_MAX;
+
+  // Nothing left, or nothing asked for: an empty read without a buffer
+  if (amt <= 0) {
+    rr->size = 0;
+    *err = 0;
+    return;
+  }
+
   char *buf = calloc(amt, sizeof(char));
   if (!buf) {
     *err = translate_errors(errno);
@@ -231,6 +476,7 @@ void file__read(int fd, int amt, ReadResult *restrict rr, Error *restrict err) {
   int amount_read = read(fd, buf, amt);
   if (amount_read < 0) {
     *err = translate_errors(errno);
+    free(buf);
     return;
   }
 
@@ -242,123 +488,273 @@ void file__read(int fd, int amt, ReadResult *restrict rr, Error *restrict err) {
   return;
 }
 
-// Reads the entirety of a files contents
-void file__read_all(int fd, ReadResult *restrict rr, Error *restrict err) {
+// Fills `buf` with up to `cap` bytes, only coming up short at EOF
+int file__read_chunk(int fd, char *restrict buf, int cap, Error *restrict err) {
   // NOTE: No permission checks here - they already obtained fd
+  line_buffer__sync(fd);
 
-  rr->data = NULL;
-  rr->size = -1;
+  int filled = 0;
+  while (filled < cap) {
+    ssize_t bytes_read = read(fd, buf + filled, cap - filled);
+    if (bytes_read < 0) {
+      if (errno == EINTR) continue;
+      *err = translate_errors(errno);
+      return -1;
+    }
+    // EOF
+    if (bytes_read == 0) break;
+    filled += bytes_read;
+  }
+
+  *err = 0;
+  return filled;
+}
+
+int file__pread(int fd, char *restrict buf, int cap, Offset offset, Error *restrict err) {
+  // NOTE: No permission checks here - they already obtained fd
+  // The offset of `fd` is never used or moved, so any read ahead is left alone
+  int filled = 0;
+  while (filled < cap) {
+    ssize_t bytes_read = pread(fd, buf + filled, cap - filled, (off_t)offset + filled);
+    if (bytes_read < 0) {
+      if (errno == EINTR) continue;
+      *err = translate_errors(errno);
+      return -1;
+    }
+    // EOF
+    if (bytes_read == 0) break;
+    filled += bytes_read;
+  }
+
+  *err = 0;
+  return filled;
+}
 
-  ssize_t buf_size = BUFSIZ;
-  // Allocate buffer on heap
-  char *buf = malloc(buf_size * sizeof(char));
-  // Initialise or pointer to the start of the buffer
-  char *ptr = buf;
+int file__pwrite(int fd, const char *restrict buf, int len, Offset offset, Error *restrict err) {
+  // NOTE: no perm checks as the user already has the file descriptor
+  // Bytes read ahead may be the ones being overwritten
+  line_buffer__sync(fd);
+  metadata_cache__invalidate_fd(fd);
+
+  int written = 0;
+  while (written < len) {
+    ssize_t n = pwrite(fd, buf + written, len - written, (off_t)offset + written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      *err = translate_errors(errno);
+      return -1;
+    }
+    written += n;
+  }
 
-  ssize_t bytes_read = 0;
+  *err = 0;
+  return written;
+}
 
-  // Keep reading as many bytes as possible, filling to the end of the buffer
-  // ((bug + buf_size) - ptr).
-  while ((bytes_read = read(fd, ptr, (buf + buf_size) - ptr)) > 0) {
-    // Move the pointer forward
-    ptr += bytes_read;
+Offset file__remaining(int fd) {
+  line_buffer__sync(fd);
 
-    ssize_t avail = (buf + buf_size) - ptr;
-    // Check if the remaining space is less than the buffer size (we can't
-    // request a full buffer for the next read)
-    if (avail < BUFSIZ) {
-      // Our minimum read request is of BUFSIZ
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return -1;
 
-      // We need to store the offset of the ptr from buf
-      // as the realloc will have a new address (most of the time)
-      ssize_t offset = ptr - buf;
+  off_t pos = lseek(fd, 0, SEEK_CUR);
+  if (pos < 0 || pos > st.st_size) return -1;
 
-      // Double the buffer size
-      void *blk = realloc(buf, buf_size * 2);
-      if (blk == NULL) {
-        // realloc failed
-        *err = translate_errors(errno);
-        free(buf);
-        return;
-      }
-      // Save the resized buffer as our new buffer
-      buf = blk;
-      // Take into account our new buffer size
-      buf_size *= 2;
+  return st.st_size - pos;
+}
 
-      // Update ptr to correct location in new buffer
-      ptr = (buf + offset);
-    }
+// Reads the entirety of a files contents
+void file__read_all(int fd, ReadResult *restrict rr, Error *restrict err) {
+  // NOTE: No permission checks here - they already obtained fd
+
+  rr->data = NULL;
+  rr->size = -1;
+
+  // If we know how much of the file is left, allocate exactly that once and
+  // read straight into it. Otherwise start at a chunk and grow as needed.
+  Offset remaining = file__remaining(fd);
+  // The terminator has to fit too
+  if (remaining >= 0 && (uint64_t)remaining >= SIZE_MAX) {
+    *err = translate_errors(EFBIG);
+    return;
   }
+  size_t buf_size = remaining >= 0 ? (size_t)remaining : CHUNK_SIZE;
 
-  // bytes_read == 0 means EOF, if this is false, there was an error in a read
-  if (bytes_read != 0) {
-    // If it is not EOF
+  // +1 for the NUL terminator
+  char *buf = malloc(buf_size + 1);
+  if (buf == NULL) {
     *err = translate_errors(errno);
-    free(buf);
     return;
   }
 
-  // NOTE: could technically reallocate here down to the exact size needed
-  // but that can also be done by the caller if it is an issue
-
-  // Calculate the total number of bytes read
-  rr->size = (ptr - buf);
-
-  // Allocate enough space for the files contents into our ReadResult struct
-  if (rr->size != 0) {
-    rr->data = malloc(rr->size * sizeof(char));
-    if (!rr->data) {
-      *err = translate_errors(errno);
-      free(buf);
-      return;
+  size_t len = 0;
+  while (true) {
+    size_t avail = buf_size - len;
+
+    if (avail == 0) {
+      // The buffer is full, make sure there is actually more to read
+      // before growing it (the common case when the size was known)
+      char probe;
+      int probed = file__read_chunk(fd, &probe, 1, err);
+      if (probed < 0) goto fail;
+      if (probed == 0) break;
+
+      size_t new_size = buf_size < CHUNK_SIZE ? CHUNK_SIZE : buf_size * 2;
+      char *blk = realloc(buf, new_size + 1);
+      if (blk == NULL) {
+        *err = translate_errors(errno);
+        goto fail;
+      }
+      buf = blk;
+      buf_size = new_size;
+      buf[len++] = probe;
+      continue;
     }
 
-    // copy the buffer into our String output struct
-    memcpy(rr->data, buf, rr->size);
+    int want = avail > INT_MAX ? INT_MAX : (int)avail;
+    int bytes_read = file__read_chunk(fd, buf + len, want, err);
+    if (bytes_read < 0) goto fail;
+    len += bytes_read;
+
+    // A short chunk means we hit EOF
+    if (bytes_read < want) break;
   }
 
-  // free the buffer
-  free(buf);
+  buf[len] = '\0';
+
+  // WARNING: MUST free in WASM!
+  rr->data = buf;
+  rr->size = len;
 
   // No error
   *err = 0;
   return;
+
+fail:
+  free(buf);
+  return;
 }
 
 void file__read_line(int fd, ReadResult *restrict rr, Error *err) {
-  FILE *stream = fdopen(fd, "r");
-  if (ferror(stream)) {
-    *err = translate_errors(errno);
-    return;
-  }
+  // NOTE: No permission checks here - they already obtained fd
 
   rr->data = NULL;
   rr->size = -1;
 
+  LineBuffer *lb = line_buffer__get(fd, err);
+  if (!lb) return;
+
   char *line = NULL;
-  size_t buffer_size = 0;
+  size_t len = 0;
+  while (true) {
+    // Refill once everything read ahead has been handed out
+    if (lb->start == lb->end) {
+      if (lb->eof) break;
+      ssize_t bytes_read;
+      do {
+        bytes_read = read(fd, lb->data, CHUNK_SIZE);
+      } while (bytes_read < 0 && errno == EINTR);
+      if (bytes_read < 0) {
+        *err = translate_errors(errno);
+        goto fail;
+      }
+      lb->start = 0;
+      lb->end = bytes_read;
+      lb->eof = bytes_read == 0;
+      continue;
+    }
+
+    char *from = lb->data + lb->start;
+    const char *newline = scan__memchr(from, '\n', lb->end - lb->start);
+    size_t take = newline ? (size_t)(newline - from) + 1 : (size_t)(lb->end - lb->start);
+
+    char *grown = realloc(line, len + take + 1);
+    if (!grown) {
+      *err = translate_errors(errno);
+      goto fail;
+    }
+    line = grown;
+    memcpy(line + len, from, take);
+    len += take;
+    lb->start += take;
 
-  ssize_t read_length = getline(&line, &buffer_size, stream);
-  if (read_length == -1) {
-    if (ferror(stream)) *err = translate_errors(errno);
-    else *err = 0; // EOF
-    fclose(stream);
-    free(line);
+    if (newline) break;
+  }
+
+  // Nothing left, let go of the block now rather than at close
+  if (len == 0) {
+    line_buffer__sync(fd);
+    *err = 0;
     return;
   }
 
+  line[len] = '\0';
+
+  // WARNING: MUST free in WASM!
   rr->data = line;
-  rr->size = (int)read_length;
+  rr->size = len;
   *err = 0;
   return;
+
+fail:
+  free(line);
+  return;
+}
+
+// Maps a whole file read-only, the mapping outlives the fd it came from
+const char *file__map(const char *restrict path, size_t *restrict len, Error *restrict err) {
+  *len = 0;
+  int fd = file__open(path, O_RDONLY, err);
+  if (fd < 0) return NULL;
+
+  // The mapping outlives the fd
+  const char *data = file__map_fd(fd, len, err);
+  close(fd);
+  return data;
+}
+
+// Maps an open file read-only from its start, whatever its offset
+const char *file__map_fd(int fd, size_t *len, Error *err) {
+  *len = 0;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    *err = translate_errors(errno);
+    return NULL;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    *err = translate_errors(EISDIR);
+    return NULL;
+  }
+
+  // Under wasm32 the address space ends well before 64-bit sizes do
+  if ((uint64_t)st.st_size > SIZE_MAX) {
+    *err = translate_errors(EFBIG);
+    return NULL;
+  }
+
+  // There's nothing to map, and mmap refuses a length of 0
+  *err = 0;
+  if (st.st_size == 0) return NULL;
+
+  void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    *err = translate_errors(errno);
+    return NULL;
+  }
+  *len = st.st_size;
+  return mapped;
+}
+
+void file__unmap(const char *data, size_t len) {
+  if (data != NULL) munmap((void *)data, len);
 }
 
 // Shifts the file offset by 'amt'
-void file__shift(int fd, int amt, Error *err) {
+void file__shift(int fd, Offset amt, Error *err) {
   // NOTE: No permission checks here - they already obtained fd
+  line_buffer__sync(fd);
 
-  int moved_bytes = lseek(fd, amt, SEEK_CUR);
+  off_t moved_bytes = lseek(fd, amt, SEEK_CUR);
   if (moved_bytes < 0) {
     *err = translate_errors(errno);
     return;
@@ -369,10 +765,11 @@ void file__shift(int fd, int amt, Error *err) {
 }
 
 // Places the file offset to `pos`
-void file__goto(int fd, int pos, Error *err) {
+void file__goto(int fd, Offset pos, Error *err) {
   // NOTE: No permission checks here - they already obtained fd
+  line_buffer__sync(fd);
 
-  int moved_bytes = lseek(fd, pos, SEEK_SET);
+  off_t moved_bytes = lseek(fd, pos, SEEK_SET);
   if (moved_bytes < 0) {
     *err = translate_errors(errno);
     return;
@@ -381,72 +778,254 @@ void file__goto(int fd, int pos, Error *err) {
   return;
 }
 
+// Opens the directory holding `path` so the node can be looked at and then
+// changed without walking the whole path twice. `scratch` (PATH_MAX bytes)
+// receives a copy of the path and `*name` is pointed at the final component
+// within it. Returns the directory's fd, AT_FDCWD for a bare name, or -1
+static int open_parent(const char *restrict path, char *restrict scratch, const char **restrict name, Error *restrict err) {
+  int len = strlen(path);
+  if (len >= PATH_MAX) {
+    *err = translate_errors(ENAMETOOLONG);
+    return -1;
+  }
+  memcpy(scratch, path, len + 1);
+
+  // Trailing slashes don't start a new component
+  while (len > 1 && scratch[len - 1] == '/') scratch[--len] = '\0';
+
+  char *slash = strrchr(scratch, '/');
+  if (slash == NULL) {
+    *name = scratch;
+    *err = 0;
+    return AT_FDCWD;
+  }
+
+  *name = slash + 1;
+  int dirfd;
+  if (slash == scratch) {
+    dirfd = open("/", O_RDONLY | O_DIRECTORY);
+  } else {
+    *slash = '\0';
+    dirfd = open(scratch, O_RDONLY | O_DIRECTORY);
+  }
+  if (dirfd < 0) {
+    *err = translate_errors(errno);
+    return -1;
+  }
+  *err = 0;
+  return dirfd;
+}
+
+static void close_parent(int dirfd) {
+  if (dirfd != AT_FDCWD) close(dirfd);
+}
+
 // Unlinks a node
 //
 // TODO: Test on directories, if it doesnt work - likely change to
 // `file__removeFile`
 void file__remove(const char *restrict path, Error *restrict err) {
+  metadata_cache__invalidate();
+  char scratch[PATH_MAX];
+  const char *name;
+  int dirfd = open_parent(path, scratch, &name, err);
+  if (dirfd == -1) return;
+
   // Permission checks
   struct stat st;
-  bool file_exists = (stat(path, &st) == 0);
+  bool file_exists = (fstatat(dirfd, name, &st, 0) == 0);
 
   if (!file_exists) {
     *err = translate_errors(EEXIST);
-    return;
+    goto cleanup;
   }
 
   // If it's a system file, fail - user can't remove system files
   if (is_system_file(&st)) {
     *err = translate_errors(EROFS);
-    return;
+    goto cleanup;
   }
 
-  int error = unlink(path);
-  if (error < 0) {
+  if (unlinkat(dirfd, name, 0) < 0) {
     *err = translate_errors(errno);
-    return;
+    goto cleanup;
   }
   *err = 0;
+
+cleanup:
+  close_parent(dirfd);
   return;
 }
 
 void file__move(const char *restrict old_path, const char *restrict new_path, Error *restrict err) {
+  metadata_cache__invalidate();
+  char old_scratch[PATH_MAX], new_scratch[PATH_MAX];
+  const char *old_name, *new_name;
+  int old_dirfd = open_parent(old_path, old_scratch, &old_name, err);
+  if (old_dirfd == -1) return;
+  int new_dirfd = open_parent(new_path, new_scratch, &new_name, err);
+  if (new_dirfd == -1) {
+    close_parent(old_dirfd);
+    return;
+  }
+
   // Permission checks [OLD FILE]
   struct stat st;
-  bool file_exists = (stat(old_path, &st) == 0);
+  bool file_exists = (fstatat(old_dirfd, old_name, &st, 0) == 0);
 
   if (!file_exists) {
     *err = translate_errors(EEXIST);
-    return;
+    goto cleanup;
   }
 
   // If it's a system file, fail - user can't move system files
   if (is_system_file(&st)) {
     *err = translate_errors(EROFS);
-    return;
+    goto cleanup;
   }
 
   // Permission checks [NEW FILE]
-  file_exists = (stat(new_path, &st) == 0);
+  file_exists = (fstatat(new_dirfd, new_name, &st, 0) == 0);
 
   // If it's a system file, fail - user can't overwrite system files
-  if (is_system_file(&st)) {
+  if (file_exists && is_system_file(&st)) {
     *err = translate_errors(EROFS);
-    return;
+    goto cleanup;
   }
 
-  int error = rename(old_path, new_path);
-  if (error < 0) {
+  if (renameat(old_dirfd, old_name, new_dirfd, new_name) < 0) {
     *err = translate_errors(errno);
-    return;
+    goto cleanup;
   }
   *err = 0;
+
+cleanup:
+  close_parent(old_dirfd);
+  close_parent(new_dirfd);
   return;
 }
 
-void file__make_dir(const char *restrict path, Error *restrict err) {
+// Where a replacement of `path` lands. A symlink is replaced through, so the
+// link stays a link and its target gets the new contents. NULL on failure
+static const char *replace_target(const char *restrict path, char *restrict resolved, Error *restrict err) {
+  struct stat st;
+  if (lstat(path, &st) < 0 || !S_ISLNK(st.st_mode)) {
+    *err = 0;
+    return path;
+  }
+  if (realpath(path, resolved) == NULL) {
+    *err = translate_errors(errno);
+    return NULL;
+  }
+  *err = 0;
+  return resolved;
+}
+
+// Closes the fd from replace_open and removes it, leaving the target alone
+static void replace_abort(int fd, const char *tmp_path) {
+  metadata_cache__invalidate();
+  fd_track(fd, false);
+  close(fd);
+  unlink(tmp_path);
+}
+
+// Opens a temporary sibling of `path` to write the new contents to, its name
+// is written to `tmp_path` (PATH_MAX bytes). Returns its fd, or -1
+static int replace_open(const char *restrict path, char *restrict tmp_path, Error *restrict err) {
+  char resolved[PATH_MAX];
+  path = replace_target(path, resolved, err);
+  if (path == NULL) return -1;
+
+  // The replacement keeps the permissions of what it replaces
+  mode_t mode = 0700;
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (S_ISDIR(st.st_mode)) {
+      *err = translate_errors(EISDIR);
+      return -1;
+    }
+    if (is_system_file(&st)) {
+      *err = translate_errors(EROFS);
+      return -1;
+    }
+    if (!can_write(&st)) {
+      *err = translate_errors(EACCES);
+      return -1;
+    }
+    mode = st.st_mode & 07777;
+  } else if (errno != ENOENT) {
+    *err = translate_errors(errno);
+    return -1;
+  }
+
+  // A hidden sibling, so the rename stays within one directory
+  const char *slash = strrchr(path, '/');
+  int dir_len = slash ? slash - path + 1 : 0;
+  int written = snprintf(tmp_path, PATH_MAX, "%.*s.%s.XXXXXX", dir_len, path, path + dir_len);
+  if (written >= PATH_MAX) {
+    *err = translate_errors(ENAMETOOLONG);
+    return -1;
+  }
+
+  metadata_cache__invalidate();
+  int fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    *err = translate_errors(errno);
+    return -1;
+  }
+  fd_track(fd, true);
+  if (fchmod(fd, mode) < 0) {
+    *err = translate_errors(errno);
+    replace_abort(fd, tmp_path);
+    return -1;
+  }
+  *err = 0;
+  return fd;
+}
+
+// Closes the fd from replace_open and renames it over `path`
+static void replace_commit(int fd, const char *restrict tmp_path, const char *restrict path, Error *restrict err) {
+  metadata_cache__invalidate();
+  // The contents have to be down before the name points at them
+  if (fsync(fd) < 0 && errno != EINVAL) {
+    *err = translate_errors(errno);
+    replace_abort(fd, tmp_path);
+    return;
+  }
+  fd_track(fd, false);
+  close(fd);
+  char resolved[PATH_MAX];
+  path = replace_target(path, resolved, err);
+  if (path == NULL) {
+    unlink(tmp_path);
+    return;
+  }
+  if (rename(tmp_path, path) < 0) {
+    *err = translate_errors(errno);
+    unlink(tmp_path);
+    return;
+  }
+  *err = 0;
+}
+
+void file__replace_contents(const char *restrict path, const char *restrict buf, int len, Error *restrict err) {
+  char tmp_path[PATH_MAX];
+  int fd = replace_open(path, tmp_path, err);
+  if (fd < 0) return;
+
+  file__reserve(fd, len, err);
+  if (*err == 0) file__write_n(fd, buf, len, err);
+  if (*err != 0) {
+    replace_abort(fd, tmp_path);
+    return;
+  }
+  replace_commit(fd, tmp_path, path, err);
+}
+
+void file__make_dir(const char *restrict path, Error *restrict err) {
   // NOTE: No permission checks as we're not enforcing permissions
   //       on directories.
+  metadata_cache__invalidate();
 
   int error = mkdir(path, 0700);
   if (error < 0) {
@@ -460,6 +1039,7 @@ void file__make_dir(const char *restrict path, Error *restrict err) {
 void file__remove_dir(const char *path, Error *err) {
   // NOTE: No permission checks as we're not enforcing permissions
   //       on directories.
+  metadata_cache__invalidate();
 
   int error = rmdir(path);
   if (error < 0) {
@@ -470,71 +1050,176 @@ void file__remove_dir(const char *path, Error *err) {
   return;
 }
 
-char **file__read_dir(const char *restrict path, int *restrict err) {
-  DIR *dir = NULL;
-  char **buf = NULL;
-  static const int CHUNK = 16;
-  int len = 0, cap = 0;
-  
-  dir = opendir(path);
-  if (dir == NULL) {
+// Reads every entry name in `dir` into one block, packed end to end and each
+// NUL terminated. The block grows geometrically so large directories cost a
+// handful of reallocs. Returns the block (MUST be freed), or NULL on error
+static char *read_packed_names(DIR *dir, size_t *restrict len, int *restrict count, Error *restrict err) {
+  size_t cap = BUFSIZ;
+  char *names = malloc(cap);
+  if (names == NULL) {
     *err = translate_errors(errno);
     return NULL;
   }
-
-  cap = CHUNK;
-  buf = malloc(cap * sizeof(*buf));
-  if (buf == NULL) {
-    *err = translate_errors(errno);
-    goto cleanup;
-  }
+  *len = 0;
+  *count = 0;
 
   while (true) {
     errno = 0;
     struct dirent *ent = readdir(dir);
     if (ent == NULL && errno != 0) {
       *err = translate_errors(errno);
-      goto cleanup;
+      free(names);
+      return NULL;
     }
     if (ent == NULL) break;
-    if (len >= cap) {
-      char **tmp = realloc(buf, (cap + CHUNK) * sizeof(*buf));
+
+    size_t name_size = strlen(ent->d_name) + 1;
+    if (*len + name_size > cap) {
+      while (cap < *len + name_size) cap *= 2;
+      char *tmp = realloc(names, cap);
       if (tmp == NULL) {
         *err = translate_errors(errno);
-        goto cleanup;
+        free(names);
+        return NULL;
       }
-      buf = tmp;
-      cap += CHUNK;
+      names = tmp;
     }
-    buf[len] = strdup(ent->d_name);
-    if (buf[len] == NULL) {
-      *err = translate_errors(errno);
-      goto cleanup;
-    }
-    len++;
+    memcpy(names + *len, ent->d_name, name_size);
+    *len += name_size;
+    (*count)++;
   }
 
-  if (len + 1 > cap) {
-    char **tmp = realloc(buf, (len + 1) * sizeof(*buf));
-    if (tmp == NULL) {
-      *err = translate_errors(errno);
-      goto cleanup;
+  *err = 0;
+  return names;
+}
+
+char **file__read_dir(const char *restrict path, Error *restrict err) {
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    *err = translate_errors(errno);
+    return NULL;
+  }
+
+  size_t len;
+  int count;
+  char *names = read_packed_names(dir, &len, &count, err);
+  closedir(dir);
+  if (names == NULL) return NULL;
+
+  // Make room for the pointer table in front of the names, in the same block
+  size_t table_size = (count + 1) * sizeof(char *);
+  char *block = realloc(names, table_size + len);
+  if (block == NULL) {
+    *err = translate_errors(errno);
+    free(names);
+    return NULL;
+  }
+  memmove(block + table_size, block, len);
+
+  char **entries = (char **)block;
+  char *name = block + table_size;
+  for (int i = 0; i < count; i++) {
+    entries[i] = name;
+    name += strlen(name) + 1;
+  }
+  entries[count] = NULL;
+
+  *err = 0;
+  return entries;
+}
+
+DirListing *file__read_dir_plus(const char *restrict path, Error *restrict err) {
+  DirListing *listing = NULL;
+
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    *err = translate_errors(errno);
+    return NULL;
+  }
+
+  size_t names_len;
+  int count;
+  char *names = read_packed_names(dir, &names_len, &count, err);
+  if (names == NULL) goto cleanup;
+
+  // Lay out the result: header, stat records, name pointers, names
+  size_t stats_at = sizeof(DirListing);
+  size_t ptrs_at = stats_at + count * sizeof(StatResult);
+  ptrs_at = (ptrs_at + _Alignof(char *) - 1) & ~(_Alignof(char *) - 1);
+  size_t names_at = ptrs_at + (count + 1) * sizeof(char *);
+  listing = malloc(names_at + names_len);
+  if (listing == NULL) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+  char *base = (char *)listing;
+  listing->count = count;
+  listing->stats = (StatResult *)(base + stats_at);
+  listing->names = (char **)(base + ptrs_at);
+  memcpy(base + names_at, names, names_len);
+
+  // Entries are cached under the directory's path, without doubling the
+  // slash of the root
+  char key[METADATA_CACHE_PATH_MAX];
+  size_t dir_len = strlen(path);
+  if (dir_len > 0 && path[dir_len - 1] == '/') dir_len--;
+  bool cacheable = dir_len + 1 < sizeof(key);
+  if (cacheable) {
+    memcpy(key, path, dir_len);
+    key[dir_len] = '/';
+  }
+
+  int at = dirfd(dir);
+  char *name = base + names_at;
+  for (int i = 0; i < count; i++) {
+    listing->names[i] = name;
+    size_t name_len = strlen(name);
+    name += name_len + 1;
+    file__statat(at, listing->names[i], &listing->stats[i], err);
+    if (*err != 0) {
+      // One entry going away doesn't make the rest of the listing wrong
+      memset(&listing->stats[i], 0, sizeof(StatResult));
+      listing->stats[i].type = -1;
+      continue;
+    }
+    if (cacheable && dir_len + 1 + name_len < sizeof(key)) {
+      memcpy(key + dir_len + 1, listing->names[i], name_len + 1);
+      metadata_cache__put(key, dir_len + 1 + name_len, &listing->stats[i]);
     }
-    buf = tmp;
   }
-  buf[len] = NULL;
+  listing->names[count] = NULL;
 
   *err = 0;
-  closedir(dir);
-  return buf;
 
 cleanup:
-  for (int i = 0; i < len; i++) {
-    free(buf[i]);
+  free(names);
+  closedir(dir);
+  return listing;
+}
+
+// Fills a StatResult from a `struct stat`, keeping the user permission bits
+// in `perm_mask`
+static void fill_stat_result(const struct stat *restrict file_stat, StatResult *restrict sr, int perm_mask) {
+  sr->size = file_stat->st_size;
+  sr->blocks = file_stat->st_blocks;
+  sr->blocksize = file_stat->st_blksize;
+  sr->ino = file_stat->st_ino;
+
+  // If it's a directory, just report `rwx`
+  if (S_ISDIR(file_stat->st_mode)) {
+    sr->type = 1; // Directory
+  } else {
+    // We only support files and directories
+    sr->type = 0; // file (technically anything that isn't a directory)
   }
-  free(buf);
-  if (dir) closedir(dir);
-  return NULL;
+
+  sr->perm = file_stat->st_mode & perm_mask; // bitmask user perms
+  sr->atime.sec = file_stat->st_atim.tv_sec;
+  sr->atime.nsec = (int)file_stat->st_atim.tv_nsec;
+  sr->mtime.sec = file_stat->st_mtim.tv_sec;
+  sr->mtime.nsec = (int)file_stat->st_mtim.tv_nsec;
+  sr->ctime.sec = file_stat->st_ctim.tv_sec;
+  sr->ctime.nsec = (int)file_stat->st_ctim.tv_nsec;
 }
 
 void file__stat(const char *restrict name, StatResult *restrict sr, Error *restrict err) {
@@ -542,33 +1227,35 @@ void file__stat(const char *restrict name, StatResult *restrict sr, Error *restr
   // This usually relies on the `x` of the parent directory,
   // but we're not implementing directory permissions
 
+  if (metadata_cache__get(name, sr)) {
+    *err = 0;
+    return;
+  }
+
   struct stat file_stat;
   if (stat(name, &file_stat) < 0) {
     *err = translate_errors(errno);
     return;
   }
 
-  sr->size = file_stat.st_size;
-  sr->blocks = file_stat.st_blocks;
-  sr->blocksize = file_stat.st_blksize;
-  sr->ino = file_stat.st_ino;
+  fill_stat_result(&file_stat, sr, 0710);
+  metadata_cache__put(name, strlen(name), sr);
+  *err = 0;
+  return;
+}
 
-  // If it's a directory, just report `rwx`
-  if (S_ISDIR(file_stat.st_mode)) {
-    sr->type = 1; // Directory
-  } else {
-    // We only support files and directories
-    sr->type = 0; // file (technically anything that isn't a directory)
-  }
+void file__statat(int dirfd, const char *restrict name, StatResult *restrict sr, Error *restrict err) {
+  // NOTE: No permission checks, user can stat anything
+  // This usually relies on the `x` of the parent directory,
+  // but we're not implementing directory permissions
 
-  sr->perm = file_stat.st_mode & 0710; // bitmask user perms
-  sr->atime.sec = (int)file_stat.st_atim.tv_sec;
-  sr->atime.nsec = (int)file_stat.st_atim.tv_nsec;
-  sr->mtime.sec = (int)file_stat.st_mtim.tv_sec;
-  sr->mtime.nsec = (int)file_stat.st_mtim.tv_nsec;
-  sr->ctime.sec = (int)file_stat.st_ctim.tv_sec;
-  sr->ctime.nsec = (int)file_stat.st_ctim.tv_nsec;
+  struct stat file_stat;
+  if (fstatat(dirfd, name, &file_stat, 0) < 0) {
+    *err = translate_errors(errno);
+    return;
+  }
 
+  fill_stat_result(&file_stat, sr, 0710);
   *err = 0;
   return;
 }
@@ -584,29 +1271,440 @@ void file__fdstat(int fd, StatResult *restrict sr, Error *restrict err) {
     return;
   }
 
-  sr->size = file_stat.st_size;
-  sr->blocks = file_stat.st_blocks;
-  sr->blocksize = file_stat.st_blksize;
-  sr->ino = file_stat.st_ino;
+  fill_stat_result(&file_stat, sr, 0700);
+  *err = 0;
+  return;
+}
 
-  // If it's a directory, just report `rwx`
-  if (S_ISDIR(file_stat.st_mode)) {
-    sr->type = 1; // Directory
-  } else {
-    // We only support files and directories
-    sr->type = 0; // file (technically anything that isn't a directory)
+// A directory file__walk is part way through
+typedef struct {
+  DIR *dir;
+  int path_len; // length of the directory's path in the walk's buffer
+} WalkFrame;
+
+struct Walk {
+  WalkOptions opts;
+  WalkFrame *stack;
+  int depth; // number of frames on the stack
+  int cap;
+  bool started;
+  WalkEntry entry;
+  char path[PATH_MAX];
+};
+
+static bool walk_reports(const Walk *walk, const WalkEntry *entry) {
+  if (entry->error != 0) return true;
+  int type = entry->stat.type == 1 ? WALK_DIRS : WALK_FILES;
+  return (walk->opts.types & type) != 0;
+}
+
+// Opens the directory `walk->entry` refers to, if the walk should go into
+// it, and pushes it. `dirfd` is its parent or AT_FDCWD for the root. A
+// directory that can't be opened is left in `walk->entry.error`, only
+// running out of memory fails the walk
+static void walk_descend(Walk *walk, int dirfd, const char *name, int path_len, Error *err) {
+  *err = 0;
+  WalkEntry *entry = &walk->entry;
+  if (entry->stat.type != 1) return;
+  if (walk->opts.max_depth >= 0 && entry->depth >= walk->opts.max_depth) return;
+  if (walk->opts.prune && walk->opts.prune(entry, walk->opts.ud)) return;
+
+  if (walk->depth == walk->cap) {
+    int cap = walk->cap ? walk->cap * 2 : 8;
+    WalkFrame *tmp = realloc(walk->stack, cap * sizeof(*tmp));
+    if (tmp == NULL) {
+      *err = translate_errors(errno);
+      return;
+    }
+    walk->stack = tmp;
+    walk->cap = cap;
   }
 
-  sr->perm = file_stat.st_mode & 0700; // bitmask user perms
-  sr->atime.sec = (int)file_stat.st_atim.tv_sec;
-  sr->atime.nsec = (int)file_stat.st_atim.tv_nsec;
-  sr->mtime.sec = (int)file_stat.st_mtim.tv_sec;
-  sr->mtime.nsec = (int)file_stat.st_mtim.tv_nsec;
-  sr->ctime.sec = (int)file_stat.st_ctim.tv_sec;
-  sr->ctime.nsec = (int)file_stat.st_ctim.tv_nsec;
+  // Relative to the parent, so the full path isn't walked again. Only the
+  // root may be reached through a link
+  int flags = O_RDONLY | O_DIRECTORY | (dirfd == AT_FDCWD ? 0 : O_NOFOLLOW);
+  int fd = openat(dirfd, name, flags);
+  if (fd < 0) {
+    entry->error = translate_errors(errno);
+    return;
+  }
+  DIR *dir = fdopendir(fd);
+  if (dir == NULL) {
+    entry->error = translate_errors(errno);
+    close(fd);
+    return;
+  }
+  walk->stack[walk->depth++] = (WalkFrame){dir, path_len};
+}
+
+Walk *file__walk_open(const char *restrict path, const WalkOptions *restrict opts, Error *restrict err) {
+  int len = strlen(path);
+  if (len >= PATH_MAX) {
+    *err = translate_errors(ENAMETOOLONG);
+    return NULL;
+  }
+
+  Walk *walk = calloc(1, sizeof(*walk));
+  if (walk == NULL) {
+    *err = translate_errors(errno);
+    return NULL;
+  }
+  walk->opts = *opts;
+  memcpy(walk->path, path, len + 1);
+
+  // Stat the root now so a bad path fails here, not on the first step
+  file__stat(walk->path, &walk->entry.stat, err);
+  if (*err != 0) {
+    free(walk);
+    return NULL;
+  }
+  return walk;
+}
+
+const WalkEntry *file__walk_next(Walk *restrict walk, Error *restrict err) {
+  WalkEntry *entry = &walk->entry;
+
+  if (!walk->started) {
+    walk->started = true;
+    entry->path = walk->path;
+    entry->name = walk->path;
+    entry->depth = 0;
+    walk_descend(walk, AT_FDCWD, walk->path, strlen(walk->path), err);
+    if (*err != 0) return NULL;
+    if (walk_reports(walk, entry)) return entry;
+  }
+
+  while (walk->depth > 0) {
+    WalkFrame *frame = &walk->stack[walk->depth - 1];
+
+    errno = 0;
+    struct dirent *ent = readdir(frame->dir);
+    if (ent == NULL) {
+      if (errno != 0) {
+        *err = translate_errors(errno);
+        return NULL;
+      }
+      // Done with this directory, back up to its parent
+      closedir(frame->dir);
+      walk->depth--;
+      continue;
+    }
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+
+    // Overwrite whatever sibling was last built after the directory's path
+    int len = frame->path_len;
+    int name_len = strlen(ent->d_name);
+    bool needs_sep = walk->path[len - 1] != '/';
+    if (len + needs_sep + name_len >= PATH_MAX) {
+      *err = translate_errors(ENAMETOOLONG);
+      return NULL;
+    }
+    if (needs_sep) walk->path[len++] = '/';
+    memcpy(walk->path + len, ent->d_name, name_len + 1);
+
+    entry->name = walk->path + len;
+    entry->depth = walk->depth;
+    entry->error = 0;
+    int dirfd_ = dirfd(frame->dir);
+    // A link is reported as its target but never entered, so a directory is
+    // only ever walked once
+    struct stat file_stat;
+    int ret = fstatat(dirfd_, entry->name, &file_stat, AT_SYMLINK_NOFOLLOW);
+    bool link = ret == 0 && S_ISLNK(file_stat.st_mode);
+    if (link) ret = fstatat(dirfd_, entry->name, &file_stat, 0);
+    if (ret < 0) {
+      // Removed since it was listed or a dangling link; report it and move on
+      entry->error = translate_errors(errno);
+      memset(&entry->stat, 0, sizeof(StatResult));
+      entry->stat.type = -1;
+      return entry;
+    }
+    fill_stat_result(&file_stat, &entry->stat, 0710);
+
+    if (!link) {
+      // NOTE: `frame` is invalid past here, descending may move the stack
+      walk_descend(walk, dirfd_, entry->name, len + name_len, err);
+      if (*err != 0) return NULL;
+    }
+    if (walk_reports(walk, entry)) return entry;
+  }
 
   *err = 0;
-  return;
+  return NULL;
+}
+
+void file__walk_close(Walk *walk) {
+  if (walk == NULL) return;
+  for (int i = 0; i < walk->depth; i++) {
+    closedir(walk->stack[i].dir);
+  }
+  free(walk->stack);
+  free(walk);
+}
+
+// Streams the rest of `in` into `out` through `buf` (CHUNK_SIZE bytes)
+static void copy_fd(int in, int out, char *restrict buf, Error *restrict err) {
+  while (true) {
+    ssize_t n = read(in, buf, CHUNK_SIZE);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      *err = translate_errors(errno);
+      return;
+    }
+    if (n == 0) break;
+
+    for (ssize_t done = 0; done < n;) {
+      ssize_t written = write(out, buf + done, n - done);
+      if (written < 0 && errno == EINTR) continue;
+      if (written < 0) {
+        *err = translate_errors(errno);
+        return;
+      }
+      done += written;
+    }
+  }
+  *err = 0;
+}
+
+// Copies the open file `in` (stat'ed as `in_st`) to `name` in `dirfd`. The
+// destination is opened first and checked on the fd, so an existing node
+// costs a single stat
+static void copy_file_at(int in, const struct stat *restrict in_st, int parent, const char *restrict name, char *restrict buf, Error *restrict err) {
+  int out = openat(parent, name, O_WRONLY | O_CREAT, 0700);
+  if (out < 0) {
+    *err = translate_errors(errno);
+    return;
+  }
+
+  struct stat st;
+  if (fstat(out, &st) < 0) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+  // Truncating would destroy the source
+  if (st.st_dev == in_st->st_dev && st.st_ino == in_st->st_ino) {
+    *err = translate_errors(EINVAL);
+    goto cleanup;
+  }
+  // User can't overwrite system files
+  if (is_system_file(&st)) {
+    *err = translate_errors(EROFS);
+    goto cleanup;
+  }
+  if (!can_write(&st)) {
+    *err = translate_errors(EACCES);
+    goto cleanup;
+  }
+  if (ftruncate(out, 0) < 0) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+  file__reserve(out, in_st->st_size, err);
+  if (*err != 0) goto cleanup;
+
+  copy_fd(in, out, buf, err);
+
+cleanup:
+  close(out);
+}
+
+void file__copy(const char *restrict src, const char *restrict dst, Error *restrict err) {
+  metadata_cache__invalidate();
+  char *buf = NULL;
+  int in = open(src, O_RDONLY);
+  if (in < 0) {
+    *err = translate_errors(errno);
+    return;
+  }
+
+  struct stat st;
+  if (fstat(in, &st) < 0) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+  if (S_ISDIR(st.st_mode)) {
+    *err = translate_errors(EISDIR);
+    goto cleanup;
+  }
+  if (!can_read(&st)) {
+    *err = translate_errors(EACCES);
+    goto cleanup;
+  }
+
+  buf = malloc(CHUNK_SIZE);
+  if (buf == NULL) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+  copy_file_at(in, &st, AT_FDCWD, dst, buf, err);
+
+cleanup:
+  free(buf);
+  close(in);
+}
+
+// Shared by every node of a file__copy_tree
+typedef struct {
+  char *buf; // the one CHUNK_SIZE buffer all files are streamed through
+  dev_t dev; // the destination root once it exists, so a destination
+  ino_t ino; // inside the source is never copied into itself
+  bool have_root;
+} CopyTree;
+
+static void copy_tree_at(CopyTree *ct, int src_dirfd, const char *restrict src_name, int dst_dirfd, const char *restrict dst_name, Error *restrict err) {
+  int in = openat(src_dirfd, src_name, O_RDONLY);
+  if (in < 0) {
+    *err = translate_errors(errno);
+    return;
+  }
+
+  struct stat st;
+  if (fstat(in, &st) < 0) {
+    *err = translate_errors(errno);
+    close(in);
+    return;
+  }
+  if (ct->have_root && st.st_dev == ct->dev && st.st_ino == ct->ino) {
+    *err = 0;
+    close(in);
+    return;
+  }
+  if (!can_read(&st)) {
+    *err = translate_errors(EACCES);
+    close(in);
+    return;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    copy_file_at(in, &st, dst_dirfd, dst_name, ct->buf, err);
+    close(in);
+    return;
+  }
+
+  DIR *dir = fdopendir(in);
+  if (dir == NULL) {
+    *err = translate_errors(errno);
+    close(in);
+    return;
+  }
+
+  // Listed before the destination is made, in case it's made inside `dir`
+  size_t len;
+  int count;
+  char *names = read_packed_names(dir, &len, &count, err);
+  if (names == NULL) {
+    closedir(dir);
+    return;
+  }
+
+  int out = -1;
+  if (mkdirat(dst_dirfd, dst_name, 0700) < 0 && errno != EEXIST) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+  out = openat(dst_dirfd, dst_name, O_RDONLY | O_DIRECTORY);
+  if (out < 0) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+
+  struct stat out_st;
+  if (fstat(out, &out_st) < 0) {
+    *err = translate_errors(errno);
+    goto cleanup;
+  }
+  if (out_st.st_dev == st.st_dev && out_st.st_ino == st.st_ino) {
+    *err = translate_errors(EINVAL);
+    goto cleanup;
+  }
+  if (!ct->have_root) {
+    ct->dev = out_st.st_dev;
+    ct->ino = out_st.st_ino;
+    ct->have_root = true;
+  }
+
+  // A failing child doesn't stop its siblings, the first error is returned
+  *err = 0;
+  for (char *name = names; name < names + len; name += strlen(name) + 1) {
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+    Error child_err;
+    copy_tree_at(ct, dirfd(dir), name, out, name, &child_err);
+    if (*err == 0) *err = child_err;
+  }
+
+cleanup:
+  if (out >= 0) close(out);
+  free(names);
+  closedir(dir);
+}
+
+void file__copy_tree(const char *restrict src, const char *restrict dst, Error *restrict err) {
+  metadata_cache__invalidate();
+  CopyTree ct = {.buf = malloc(CHUNK_SIZE), .have_root = false};
+  if (ct.buf == NULL) {
+    *err = translate_errors(errno);
+    return;
+  }
+  copy_tree_at(&ct, AT_FDCWD, src, AT_FDCWD, dst, err);
+  free(ct.buf);
+}
+
+static void remove_tree_at(int parent, const char *restrict name, Error *restrict err) {
+  struct stat st;
+  if (fstatat(parent, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+    *err = translate_errors(errno);
+    return;
+  }
+  // User can't remove system nodes, nor anything beneath them
+  if (is_system_file(&st)) {
+    *err = translate_errors(EROFS);
+    return;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    *err = unlinkat(parent, name, 0) < 0 ? translate_errors(errno) : 0;
+    return;
+  }
+
+  int fd = openat(parent, name, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    *err = translate_errors(errno);
+    return;
+  }
+  DIR *dir = fdopendir(fd);
+  if (dir == NULL) {
+    *err = translate_errors(errno);
+    close(fd);
+    return;
+  }
+
+  // Listed up front, removing entries while reading the directory may skip some
+  size_t len;
+  int count;
+  char *names = read_packed_names(dir, &len, &count, err);
+  if (names == NULL) {
+    closedir(dir);
+    return;
+  }
+  // A failing child doesn't stop its siblings, the first error is returned
+  *err = 0;
+  for (char *entry = names; entry < names + len; entry += strlen(entry) + 1) {
+    if (strcmp(entry, ".") == 0 || strcmp(entry, "..") == 0) continue;
+    Error child_err;
+    remove_tree_at(dirfd(dir), entry, &child_err);
+    if (*err == 0) *err = child_err;
+  }
+  free(names);
+  closedir(dir);
+
+  if (*err == 0 && unlinkat(parent, name, AT_REMOVEDIR) < 0) {
+    *err = translate_errors(errno);
+  }
+}
+
+void file__remove_tree(const char *restrict path, Error *restrict err) {
+  metadata_cache__invalidate();
+  remove_tree_at(AT_FDCWD, path, err);
 }
 
 void file__change_dir(const char *restrict path, Error *restrict err) {
@@ -624,45 +1722,119 @@ void file__change_dir(const char *restrict path, Error *restrict err) {
 // Changes FILE permissions (only for user - single user OS,
 // 0[use][ignore][ignore])
 void file__permit(const char *restrict path, int flags, Error *restrict err) {
+  metadata_cache__invalidate();
+  char scratch[PATH_MAX];
+  const char *name;
+  int dirfd = open_parent(path, scratch, &name, err);
+  if (dirfd == -1) return;
+
   // permissions check
   struct stat st;
-  bool file_exists = (stat(path, &st) == 0);
+  bool file_exists = (fstatat(dirfd, name, &st, 0) == 0);
 
   if (!file_exists) {
     *err = translate_errors(EEXIST);
-    return;
+    goto cleanup;
   }
 
   // If it's a directory, fail - as this does nothing in our system
   // and might even break it due to emscripten's emulation
   if (S_ISDIR(st.st_mode)) {
     *err = translate_errors(EISDIR);
-    return;
+    goto cleanup;
   }
 
   // If it's a system file, fail
   if (is_system_file(&st)) {
     *err = translate_errors(EROFS);
-    return;
+    goto cleanup;
   }
 
   // No permissions check here - user should be allowed to modify all file
   // permissions
   // TODO: Figure out how to modify
-  if (chmod(path, flags) < 0) {
+  if (fchmodat(dirfd, name, flags, 0) < 0) {
     *err = translate_errors(errno);
-    return;
+    goto cleanup;
   }
-
   *err = 0;
+
+cleanup:
+  close_parent(dirfd);
   return;
 }
 
-void file__truncate(int fd, int length, Error *err) {
+// MEMFS keeps a file's bytes in one array, grown by writes as they go and
+// never shrunk unless the size changes. Sets that array's length to
+// `capacity` (never below the file's size); with `grow_only` room already
+// there is kept
+static void memfs__set_capacity(int fd, Offset capacity, bool grow_only) {
+#ifdef __EMSCRIPTEN__
+  MAIN_THREAD_EM_ASM(
+      {
+        const stream = FS.getStream($0);
+        if (!stream) return;
+        // Processes reach the main filesystem through PROXYFS, whose
+        // streams wrap the one opened on the real node
+        const node = (stream.nfd || stream).node;
+        if (!node || !FS.isFile(node.mode)) return;
+        if (node.contents !== null && !ArrayBuffer.isView(node.contents)) return;
+
+        const have = node.contents ? node.contents.length : 0;
+        const want = Math.max($1, node.usedBytes);
+        if (want == have || ($2 && want < have)) return;
+
+        let contents = null;
+        if (want > 0) {
+          contents = new Uint8Array(want);
+          if (node.contents) contents.set(node.contents.subarray(0, node.usedBytes));
+        }
+        node.contents = contents;
+      },
+      fd, (double)capacity, grow_only);
+#else
+  (void)fd;
+  (void)capacity;
+  (void)grow_only;
+#endif
+}
+
+void file__truncate(int fd, Offset length, Error *err) {
+  line_buffer__sync(fd);
+  metadata_cache__invalidate_fd(fd);
   if (ftruncate(fd, length) == -1) {
     *err = translate_errors(errno);
     return;
   }
+  // MEMFS skips resizing when the size doesn't change, which would leave
+  // a reservation past the end in place
+  memfs__set_capacity(fd, length, false);
+  *err = 0;
+}
+
+void file__reserve(int fd, Offset size, Error *err) {
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    *err = translate_errors(errno);
+    return;
+  }
+  // Only a hint, nothing to do if the file is already that big
+  if (!S_ISREG(st.st_mode) || size <= st.st_size) {
+    *err = 0;
+    return;
+  }
+
+  metadata_cache__invalidate_fd(fd);
+#ifdef __EMSCRIPTEN__
+  memfs__set_capacity(fd, size, true);
+#elif defined(FALLOC_FL_KEEP_SIZE)
+  // Filesystems without preallocation just grow as they're written
+  if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) < 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+    *err = translate_errors(errno);
+    return;
+  }
+#endif
+  *err = 0;
 }
 
 // Resulting pointer has static lifetime
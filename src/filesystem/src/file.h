@@ -11,10 +11,13 @@
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <limits.h>
 
@@ -29,6 +32,20 @@
 #endif
 #define BUFSIZ 1024
 
+// Chunk size used when streaming the contents of an open file
+#define CHUNK_SIZE (64 * 1024)
+
+// Most slices file__writev will hand to the kernel in a single call
+#define WRITEV_BATCH 64
+
+// Stats file__stat keeps around, looked up by absolute path
+#define METADATA_CACHE_SIZE 128
+// Paths this long or longer are stat'ed every time rather than cached
+#define METADATA_CACHE_PATH_MAX 256
+// How long a cached stat is trusted. Changes made in this process drop the
+// cache straight away, this bounds how stale other processes' changes look
+#define METADATA_CACHE_TTL_MS 1000
+
 // If this bit is set on any files, they cannot be modified
 // and are considered system files.
 #define PROTECTED_BIT 0010
@@ -54,42 +71,103 @@
 // >0 if an error is reported
 typedef int Error;
 
+// Sizes of and positions in files. 64-bit even under wasm32, so files past
+// 2 GiB can be worked with
+typedef int64_t Offset;
+
 // Output parameter struct, filled with file content when read
 typedef struct __attribute__((packed)) {
   char *data; // WARNING: MUST BE FREED IN WASM/JS
   int size;
 } ReadResult;
 
+// Input parameter struct, one of the pieces written by file__writev
+typedef struct __attribute__((packed)) {
+  const char *data;
+  int size;
+} WriteSlice;
+
 // Used in StatResult struct - matches POSIX `struct timespec`
 typedef struct __attribute__((packed)) {
-  int sec;
+  int64_t sec;
   int nsec;
 } Time;
 
 // Output parameter struct, filled with a node's stat content
 typedef struct __attribute__((packed)) {
-  int size;
-  int blocks;
+  Offset size;
+  Offset blocks;
   int blocksize;
   int ino;
   int perm; // permissions (Only user: 01 Read, 001 Write, 0001 Execute) 20
             // bytes
-  int type; // 0: file, 1: directory
+  int type; // 0: file, 1: directory, -1: couldn't be stat'ed (file__read_dir_plus)
   Time atime;
   Time mtime;
   Time ctime;
 } StatResult; 
 
+// Output of file__read_dir_plus, a directory's entries with their stats.
+// The struct, its records and the names all live in one allocation
+typedef struct __attribute__((packed)) {
+  int count;
+  StatResult *stats; // `count` records, in the same order as `names`
+  char **names;      // `count` names, NULL terminated
+} DirListing;
+
+// Counters for the metadata cache, since the process started
+typedef struct {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long invalidations; // changes that dropped every entry
+  int entries;                 // entries that could still be hit
+  int capacity;
+} MetadataCacheStats;
+
+// Which nodes file__walk reports, directories are descended into either way
+#define WALK_FILES 1
+#define WALK_DIRS 2
+
+// A node visited by file__walk
+typedef struct {
+  const char *path; // full path of the node, only valid until the next step
+  const char *name; // final component of `path`
+  int depth;        // 0 for the root of the walk
+  StatResult stat;  // of a link's target
+  Error error;      // why the node couldn't be stat'ed (stat.type is -1) or
+                    // opened, such nodes are always reported and never entered
+} WalkEntry;
+
+// Called on each directory before file__walk descends into it, returning
+// true skips everything beneath it
+typedef bool (*WalkPrune)(const WalkEntry *entry, void *ud);
+
+typedef struct {
+  int max_depth;   // deepest level reported, -1 for no limit
+  int types;       // WALK_FILES and/or WALK_DIRS
+  WalkPrune prune; // may be NULL
+  void *ud;        // handed to `prune`
+} WalkOptions;
+
+// An in-progress file__walk
+typedef struct Walk Walk;
+
 #ifdef FILE_IMPL
 const int sizeof_ReadResult = sizeof(ReadResult);
 const int offsetof_ReadResult__data = offsetof(ReadResult, data);
 const int offsetof_ReadResult__size = offsetof(ReadResult, size);
+const int sizeof_WriteSlice = sizeof(WriteSlice);
+const int offsetof_WriteSlice__data = offsetof(WriteSlice, data);
+const int offsetof_WriteSlice__size = offsetof(WriteSlice, size);
 const int sizeof_Time = sizeof(Time);
 const int offsetof_Time__sec = offsetof(Time, sec);
+const int sizeof_Time__sec = sizeof(((Time *)0)->sec);
 const int offsetof_Time__nsec = offsetof(Time, nsec);
 const int sizeof_StatResult = sizeof(StatResult);
 const int offsetof_StatResult__size = offsetof(StatResult, size);
+const int sizeof_StatResult__size = sizeof(((StatResult *)0)->size);
 const int offsetof_StatResult__blocks = offsetof(StatResult, blocks);
+const int sizeof_StatResult__blocks = sizeof(((StatResult *)0)->blocks);
 const int offsetof_StatResult__blocksize = offsetof(StatResult, blocksize);
 const int offsetof_StatResult__ino = offsetof(StatResult, ino);
 const int offsetof_StatResult__perm = offsetof(StatResult, perm);
@@ -97,6 +175,10 @@ const int offsetof_StatResult__type = offsetof(StatResult, type);
 const int offsetof_StatResult__atime = offsetof(StatResult, atime);
 const int offsetof_StatResult__mtime = offsetof(StatResult, mtime);
 const int offsetof_StatResult__ctime = offsetof(StatResult, ctime);
+const int sizeof_DirListing = sizeof(DirListing);
+const int offsetof_DirListing__count = offsetof(DirListing, count);
+const int offsetof_DirListing__stats = offsetof(DirListing, stats);
+const int offsetof_DirListing__names = offsetof(DirListing, names);
 #endif
 
 // ======================= Filesystem API =======================
@@ -109,32 +191,81 @@ void file__pushToPersist(void);
 void file__pullFromPersist(void);
 
 // Opens a file, only uses user flags, ignores any others provided
-// INFO: Performs permission and existence checks
+// INFO: Performs permission and existence checks, on the opened fd itself
+//       so the path is only walked once. A rejected fd is closed again
 int file__open(const char *restrict path, int flags, Error *restrict err);
 
 // Closes an open file
 void file__close(int fd, Error *err);
 
-// Writes to an open file
+// Writes a NUL terminated string to an open file
 void file__write(int fd, const char *restrict content, Error *restrict err);
 
-// Reads from an open file until newline or EOF
+// Writes `len` bytes of `buf` to an open file, NUL bytes included
+void file__write_n(int fd, const char *restrict buf, int len, Error *restrict err);
+
+// Writes `count` slices to an open file in order, gathering them into as few
+// writes as possible
+void file__writev(int fd, const WriteSlice *restrict slices, int count, Error *restrict err);
+
+// Reads from an open file until newline or EOF, the newline is kept and
+// rr->data is NUL terminated. At EOF rr->data is NULL with no error.
+// Reads ahead a block at a time, any other call that reads, writes or moves
+// the offset of `fd` hands unread bytes back first so they can be mixed
 // WARNING: rr->data MUST be freed
 void file__read_line(int fd, ReadResult *restrict rr, Error *err);
 
-// Reads `amt` bytes in an open file
+// Reads up to `amt` bytes in an open file, never more than is left in it
 // WARNING: rr->data MUST be freed in WASM/JS
-void file__read(int fd, int amt, ReadResult *restrict rr, Error *restrict err);
+void file__read(int fd, Offset amt, ReadResult *restrict rr, Error *restrict err);
+
+// Reads the next chunk of an open file into a caller-owned buffer.
+// Keeps reading until `buf` holds `cap` bytes or EOF is reached, so every
+// chunk but the last is full. Returns the amount read, 0 on EOF, -1 on error
+int file__read_chunk(int fd, char *restrict buf, int cap, Error *restrict err);
+
+// Reads up to `cap` bytes from `offset` in an open file, without using or
+// moving its cursor. Returns the amount read, short only at EOF, -1 on error
+int file__pread(int fd, char *restrict buf, int cap, Offset offset, Error *restrict err);
+
+// Writes all `len` bytes of `buf` at `offset` in an open file, without using
+// or moving its cursor. Returns the amount written, -1 on error
+int file__pwrite(int fd, const char *restrict buf, int len, Offset offset, Error *restrict err);
+
+// Returns how many bytes are left between an open file's cursor and its end,
+// or -1 if that can't be known up front (e.g. it isn't a regular file)
+Offset file__remaining(int fd);
 
 // Reads an open file in its entirety
+// INFO: rr->data is NUL terminated, rr->size does not include the terminator
 // WARNING: rr->data MUST be freed in WASM/JS
 void file__read_all(int fd, ReadResult *restrict rr, Error *restrict err);
 
+// Maps a file read-only into memory, for scanning it without reading it into
+// a buffer. The size is written to `len`, an empty file maps to NULL
+// INFO: Under Emscripten MEMFS the mapping is a private copy in the heap
+// WARNING: MUST be released with file__unmap
+const char *file__map(const char *restrict path, size_t *restrict len, Error *restrict err);
+
+// file__map for a file that's already open, always from its start whatever
+// the fd's offset. The fd may be closed once it's mapped
+const char *file__map_fd(int fd, size_t *len, Error *err);
+
+void file__unmap(const char *data, size_t len);
+
+// Replaces a file's contents all at once. They are written to a temporary
+// sibling which is then renamed over `path`, so anything looking at `path`
+// (IDBFS included) only ever sees the old or the new contents, never a mix.
+// A missing file is created, an existing one keeps its permissions. A
+// symlink is replaced through, updating its target and leaving the link.
+// INFO: Ensures `path` isn't a system node or a read-only file
+void file__replace_contents(const char *restrict path, const char *restrict buf, int len, Error *restrict err);
+
 // Shifts an open file's cursor by `amt` bytes
-void file__shift(int fd, int amt, Error *err);
+void file__shift(int fd, Offset amt, Error *err);
 
 // Places an open file's cursor to `pos` (relative to 0)
-void file__goto(int fd, int pos, Error *err);
+void file__goto(int fd, Offset pos, Error *err);
 
 // Removes a file
 // INFO: Ensures `path` isn't a system node
@@ -150,25 +281,76 @@ void file__make_dir(const char *restrict path, Error *restrict err);
 // Removes a directory
 void file__remove_dir(const char *restrict path, Error *restrict err);
 
+// Copies a file, streaming it through a fixed buffer. `dst` is created or
+// truncated, but never if it's a system file
+void file__copy(const char *restrict src, const char *restrict dst, Error *restrict err);
+
+// Copies a file, or a directory and everything beneath it, into `dst`.
+// Directories that already exist are merged into. Each node is checked once
+// when it's opened, and the whole copy shares a single buffer
+// INFO: A node that fails doesn't stop the rest, the first error is returned
+void file__copy_tree(const char *restrict src, const char *restrict dst, Error *restrict err);
+
+// Removes a file, or a directory and everything beneath it
+// INFO: Refuses system nodes and their parents, removing everything else.
+// The first error is returned
+void file__remove_tree(const char *restrict path, Error *restrict err);
+
 // Changes the user's current directory
 void file__change_dir(const char *restrict path, Error *restrict err);
 
-// Reads a directory
-// WARNING: entry->name MUST be freed in WASM/JS
-char **file__read_dir(const char *restrict path, Error *restrict err); // Keep calling, state kept in DIR*
-
-// Stats a node
+// Reads a directory into a NULL terminated array of names. The array and
+// the names it points to are one block
+// WARNING: The returned array MUST be freed (a single free) in WASM/JS
+char **file__read_dir(const char *restrict path, Error *restrict err);
+
+// Reads a directory and stats every entry in the same pass, entries are
+// looked up relative to the open directory rather than by full path. An
+// entry that can't be stat'ed (removed since it was listed, a dangling link)
+// is kept with its record's type set to -1
+// WARNING: The returned DirListing MUST be freed (a single free) in WASM/JS
+DirListing *file__read_dir_plus(const char *restrict path, Error *restrict err);
+
+// Walks the tree under `path` depth first, the root first then each entry
+// before its children. Only one open directory is held per level and the
+// path is built in a single reused buffer. Symlinks below the root are
+// reported as their target but never entered, so a link to an ancestor can't
+// loop, and a node that fails is reported with its `error` while the walk
+// carries on
+// WARNING: MUST be closed with file__walk_close
+Walk *file__walk_open(const char *restrict path, const WalkOptions *restrict opts, Error *restrict err);
+
+// Steps the walk, returning NULL once it's done or on an error that ends the
+// walk (with `err` set)
+const WalkEntry *file__walk_next(Walk *restrict walk, Error *restrict err);
+
+void file__walk_close(Walk *walk);
+
+// Stats a node, served from the metadata cache when `path` is absolute and
+// was stat'ed (or listed by file__read_dir_plus) recently
 void file__stat(const char *restrict path, StatResult *restrict sr, Error *restrict err);
 
+// Stats `name` relative to an open directory `dirfd` (or AT_FDCWD), so the
+// directory's own path isn't walked again
+void file__statat(int dirfd, const char *restrict name, StatResult *restrict sr, Error *restrict err);
+
 // Stats an open file
 void file__fdstat(int fd, StatResult *restrict sr, Error *restrict err);
 
+// Reports the metadata cache's counters
+void file__cache_stats(MetadataCacheStats *stats);
+
 // Changes permissions on a file
 // INFO: Ensures `path` isn't a system node
 void file__permit(const char *restrict path, int flags, Error *restrict err);
 
-// Force file to be `length` size in bytes
-void file__truncate(int fd, int length, Error *restrict err);
+// Force file to be `length` size in bytes, releasing any room reserved
+// past the end
+void file__truncate(int fd, Offset length, Error *restrict err);
+
+// Hints that the file will grow to `size` bytes, so room for it is set aside
+// once rather than grown write by write. The file's size doesn't change
+void file__reserve(int fd, Offset size, Error *restrict err);
 
 // Returns the current working directory
 char *file__cwd(Error *restrict err);
@@ -0,0 +1,234 @@
+#include "scan.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Most bytes find_any compares a block against at once, larger sets fall
+// back to a lookup table
+#define FIND_ANY_VECTORS 8
+
+// ======================= Scalar =======================
+
+const char *scan__memchr_scalar(const char *s, int c, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (s[i] == (char)c) return s + i;
+  }
+  return NULL;
+}
+
+const char *scan__memrchr_scalar(const char *s, int c, size_t n) {
+  while (n > 0) {
+    n--;
+    if (s[n] == (char)c) return s + n;
+  }
+  return NULL;
+}
+
+size_t scan__count_byte_scalar(const char *s, int c, size_t n) {
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++) count += s[i] == (char)c;
+  return count;
+}
+
+const char *scan__find_any_scalar(const char *s, size_t n, const char *set, size_t set_len) {
+  bool in_set[256] = {false};
+  for (size_t i = 0; i < set_len; i++) in_set[(unsigned char)set[i]] = true;
+  for (size_t i = 0; i < n; i++) {
+    if (in_set[(unsigned char)s[i]]) return s + i;
+  }
+  return NULL;
+}
+
+// ======================= Vector kernels =======================
+
+// Stamps out the four kernels for one instruction set, given:
+//   VEC, WIDTH        the vector type and how many bytes it holds
+//   V_SPLAT(c)        every lane set to `c`
+//   V_LOAD(p)         an unaligned load
+//   V_EQ(a, b)        0xFF in lanes that are equal, 0 elsewhere
+//   V_OR(a, b)
+//   V_MASK(v)         the top bit of each lane packed into an integer
+//   V_SUB(a, b)       lane-wise subtraction, used to count matches
+//   V_ZERO()
+//   V_HSUM(v)         the sum of every (unsigned) lane
+// Blocks are scanned whole and whatever is left is handed to the scalar code
+#define SCAN_KERNELS(NAME, ATTR)                                                                         \
+  ATTR static const char *memchr_##NAME(const char *s, int c, size_t n) {                                \
+    VEC needle = V_SPLAT(c);                                                                             \
+    size_t i = 0;                                                                                        \
+    for (; i + WIDTH <= n; i += WIDTH) {                                                                 \
+      uint32_t mask = V_MASK(V_EQ(V_LOAD(s + i), needle));                                               \
+      if (mask) return s + i + __builtin_ctz(mask);                                                      \
+    }                                                                                                    \
+    return scan__memchr_scalar(s + i, c, n - i);                                                         \
+  }                                                                                                      \
+                                                                                                         \
+  ATTR static const char *memrchr_##NAME(const char *s, int c, size_t n) {                               \
+    VEC needle = V_SPLAT(c);                                                                             \
+    size_t i = n;                                                                                        \
+    while (i >= WIDTH) {                                                                                 \
+      i -= WIDTH;                                                                                        \
+      uint32_t mask = V_MASK(V_EQ(V_LOAD(s + i), needle));                                               \
+      if (mask) return s + i + (31 - __builtin_clz(mask));                                               \
+    }                                                                                                    \
+    return scan__memrchr_scalar(s, c, i);                                                                \
+  }                                                                                                      \
+                                                                                                         \
+  ATTR static size_t count_byte_##NAME(const char *s, int c, size_t n) {                                 \
+    VEC needle = V_SPLAT(c);                                                                             \
+    size_t count = 0;                                                                                    \
+    size_t i = 0;                                                                                        \
+    while (i + WIDTH <= n) {                                                                             \
+      /* Matches are counted per lane, so sum them up before any lane can wrap */                        \
+      size_t blocks = (n - i) / WIDTH;                                                                   \
+      if (blocks > 255) blocks = 255;                                                                    \
+      VEC acc = V_ZERO();                                                                                \
+      for (size_t b = 0; b < blocks; b++, i += WIDTH) {                                                  \
+        acc = V_SUB(acc, V_EQ(V_LOAD(s + i), needle));                                                   \
+      }                                                                                                  \
+      count += V_HSUM(acc);                                                                              \
+    }                                                                                                    \
+    return count + scan__count_byte_scalar(s + i, c, n - i);                                             \
+  }                                                                                                      \
+                                                                                                         \
+  ATTR static const char *find_any_##NAME(const char *s, size_t n, const char *set, size_t set_len) {    \
+    VEC needles[FIND_ANY_VECTORS];                                                                       \
+    for (size_t k = 0; k < set_len; k++) needles[k] = V_SPLAT(set[k]);                                   \
+    size_t i = 0;                                                                                        \
+    for (; i + WIDTH <= n; i += WIDTH) {                                                                 \
+      VEC block = V_LOAD(s + i);                                                                         \
+      VEC hits = V_EQ(block, needles[0]);                                                                \
+      for (size_t k = 1; k < set_len; k++) hits = V_OR(hits, V_EQ(block, needles[k]));                  \
+      uint32_t mask = V_MASK(hits);                                                                      \
+      if (mask) return s + i + __builtin_ctz(mask);                                                      \
+    }                                                                                                    \
+    return scan__find_any_scalar(s + i, n - i, set, set_len);                                            \
+  }
+
+#if defined(__wasm_simd128__)
+
+#define VEC v128_t
+#define WIDTH 16
+#define V_SPLAT(c) wasm_i8x16_splat((int8_t)(c))
+#define V_LOAD(p) wasm_v128_load(p)
+#define V_EQ(a, b) wasm_i8x16_eq(a, b)
+#define V_OR(a, b) wasm_v128_or(a, b)
+#define V_MASK(v) wasm_i8x16_bitmask(v)
+#define V_SUB(a, b) wasm_i8x16_sub(a, b)
+#define V_ZERO() wasm_i8x16_splat(0)
+#define V_HSUM(v) simd128_hsum(v)
+
+static inline size_t simd128_hsum(v128_t v) {
+  v128_t sums = wasm_u32x4_extadd_pairwise_u16x8(wasm_u16x8_extadd_pairwise_u8x16(v));
+  return (uint32_t)wasm_i32x4_extract_lane(sums, 0) + (uint32_t)wasm_i32x4_extract_lane(sums, 1) +
+         (uint32_t)wasm_i32x4_extract_lane(sums, 2) + (uint32_t)wasm_i32x4_extract_lane(sums, 3);
+}
+
+SCAN_KERNELS(simd128, )
+
+#define KERNEL(name) name##_simd128
+
+#elif defined(__SSE2__)
+
+#define VEC __m128i
+#define WIDTH 16
+#define V_SPLAT(c) _mm_set1_epi8((char)(c))
+#define V_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define V_EQ(a, b) _mm_cmpeq_epi8(a, b)
+#define V_OR(a, b) _mm_or_si128(a, b)
+#define V_MASK(v) (uint32_t) _mm_movemask_epi8(v)
+#define V_SUB(a, b) _mm_sub_epi8(a, b)
+#define V_ZERO() _mm_setzero_si128()
+#define V_HSUM(v) sse2_hsum(v)
+
+static inline size_t sse2_hsum(__m128i v) {
+  // Two 64-bit sums, each small enough to read back as 16 bits
+  __m128i sums = _mm_sad_epu8(v, _mm_setzero_si128());
+  return _mm_extract_epi16(sums, 0) + _mm_extract_epi16(sums, 4);
+}
+
+SCAN_KERNELS(sse2, )
+
+#undef VEC
+#undef WIDTH
+#undef V_SPLAT
+#undef V_LOAD
+#undef V_EQ
+#undef V_OR
+#undef V_MASK
+#undef V_SUB
+#undef V_ZERO
+#undef V_HSUM
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define VEC __m256i
+#define WIDTH 32
+#define V_SPLAT(c) _mm256_set1_epi8((char)(c))
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define V_EQ(a, b) _mm256_cmpeq_epi8(a, b)
+#define V_OR(a, b) _mm256_or_si256(a, b)
+#define V_MASK(v) (uint32_t) _mm256_movemask_epi8(v)
+#define V_SUB(a, b) _mm256_sub_epi8(a, b)
+#define V_ZERO() _mm256_setzero_si256()
+#define V_HSUM(v) avx2_hsum(v)
+
+AVX2 static inline size_t avx2_hsum(__m256i v) {
+  __m256i sums = _mm256_sad_epu8(v, _mm256_setzero_si256());
+  return _mm256_extract_epi16(sums, 0) + _mm256_extract_epi16(sums, 4) + _mm256_extract_epi16(sums, 8) +
+         _mm256_extract_epi16(sums, 12);
+}
+
+SCAN_KERNELS(avx2, AVX2)
+
+// AVX2 isn't a given on x86, so it's picked once the CPU has been asked
+static bool has_avx2(void) {
+  static int cached = -1;
+  if (cached < 0) cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+  return cached;
+}
+
+#define KERNEL(name) (has_avx2() ? name##_avx2 : name##_sse2)
+
+#endif
+
+// ======================= Dispatch =======================
+
+const char *scan__memchr(const char *s, int c, size_t n) {
+#ifdef KERNEL
+  return KERNEL(memchr)(s, c, n);
+#else
+  return scan__memchr_scalar(s, c, n);
+#endif
+}
+
+const char *scan__memrchr(const char *s, int c, size_t n) {
+#ifdef KERNEL
+  return KERNEL(memrchr)(s, c, n);
+#else
+  return scan__memrchr_scalar(s, c, n);
+#endif
+}
+
+size_t scan__count_byte(const char *s, int c, size_t n) {
+#ifdef KERNEL
+  return KERNEL(count_byte)(s, c, n);
+#else
+  return scan__count_byte_scalar(s, c, n);
+#endif
+}
+
+const char *scan__find_any(const char *s, size_t n, const char *set, size_t set_len) {
+  if (set_len == 0) return NULL;
+  if (set_len == 1) return scan__memchr(s, (unsigned char)set[0], n);
+#ifdef KERNEL
+  if (set_len <= FIND_ANY_VECTORS) return KERNEL(find_any)(s, n, set, set_len);
+#endif
+  return scan__find_any_scalar(s, n, set, set_len);
+}
@@ -0,0 +1,31 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// Byte search kernels for splitting lines and scanning file contents.
+//
+// Built on wasm simd128 when compiled with -msimd128, on SSE2 natively (with
+// AVX2 picked at runtime where the CPU has it), and byte at a time otherwise.
+// None of them read outside of [s, s + n).
+
+// First `c` in `s`, or NULL
+const char *scan__memchr(const char *s, int c, size_t n);
+
+// Last `c` in `s`, or NULL
+const char *scan__memrchr(const char *s, int c, size_t n);
+
+// How many times `c` appears in `s`
+size_t scan__count_byte(const char *s, int c, size_t n);
+
+// First byte in `s` that is any of the `set_len` bytes in `set`, or NULL
+const char *scan__find_any(const char *s, size_t n, const char *set, size_t set_len);
+
+// The plain byte at a time versions, kept as the reference the kernels
+// above are checked and benchmarked against
+const char *scan__memchr_scalar(const char *s, int c, size_t n);
+const char *scan__memrchr_scalar(const char *s, int c, size_t n);
+size_t scan__count_byte_scalar(const char *s, int c, size_t n);
+const char *scan__find_any_scalar(const char *s, size_t n, const char *set, size_t set_len);
+
+#endif
@@ -434,6 +434,76 @@ describe("Filesystem tests", () => {
 
   });
 
+  it("Read and write at positions without moving the cursor", async () => {
+    const assertions = await page.evaluate(async () => {
+      let fd, error;
+      let assertions = [];
+
+      ({ fd, error } = window.Filesystem.open("/persistent/positional.txt", "rwc"));
+      assertions.push({ cond: error === null, msg: "error opening file" });
+      ({ error } = window.Filesystem.write(fd, "0123456789"));
+      assertions.push({ cond: error === null, msg: "error writing file" });
+      ({ error } = window.Filesystem.goto(fd, 2));
+      assertions.push({ cond: error === null, msg: "error moving cursor" });
+      let data, size;
+      ({ error, size } = window.Filesystem.writeAt(fd, 3, "abc"));
+      assertions.push({ cond: error === null, msg: "error writing at a position" });
+      assertions.push({ cond: size === 3, msg: "writeAt returned the wrong length" });
+      ({ error, data, size } = window.Filesystem.readAt(fd, 2, 5));
+      assertions.push({ cond: error === null, msg: "error reading at a position" });
+      assertions.push({ cond: data === "2abc6" && size === 5, msg: "readAt returned the wrong data" });
+      ({ data, size } = window.Filesystem.readAt(fd, 8, 10));
+      assertions.push({ cond: data === "89" && size === 2, msg: "readAt past the end should stop at EOF" });
+      ({ data } = window.Filesystem.read(fd, 3));
+      assertions.push({ cond: data === "2ab", msg: "positional calls moved the cursor" });
+      ({ error } = window.Filesystem.close(fd));
+      assertions.push({ cond: error === null, msg: "error closing file" });
+
+      return assertions;
+    });
+
+    for (let assertion of assertions) {
+      assert.ok(assertion.cond, assertion.msg);
+    }
+  });
+
+  it("Replace a file's contents", async () => {
+    const assertions = await page.evaluate(async () => {
+      let fd, error;
+      let assertions = [];
+
+      ({ fd, error } = window.Filesystem.open("/persistent/replace.txt", "wc"));
+      assertions.push({ cond: error === null, msg: "error opening file" });
+      window.Filesystem.write(fd, "A much longer original line");
+      window.Filesystem.close(fd);
+
+      ({ error } = window.Filesystem.replaceContents("/persistent/replace.txt", "Replaced ✓"));
+      assertions.push({ cond: error === null, msg: "error replacing contents" });
+      ({ fd } = window.Filesystem.open("/persistent/replace.txt", "r"));
+      let { data } = window.Filesystem.readAll(fd);
+      window.Filesystem.close(fd);
+      assertions.push({ cond: data === "Replaced ✓", msg: "replace left the wrong contents" });
+
+      window._FSM.FS.chmod("/persistent/replace.txt", 0o710); // Protected system file
+      ({ error } = window.Filesystem.replaceContents("/persistent/replace.txt", "nope"));
+      assertions.push({ cond: error !== null, msg: "replaced a protected system file" });
+      window._FSM.FS.chmod("/persistent/replace.txt", 0o700);
+      window.Filesystem.remove("/persistent/replace.txt");
+
+      let { entries } = window.Filesystem.read_dir("/persistent");
+      assertions.push({
+        cond: !entries.some((name) => name.startsWith(".replace.txt")),
+        msg: "a temporary file was left behind"
+      });
+
+      return assertions;
+    });
+
+    for (let assertion of assertions) {
+      assert.ok(assertion.cond, assertion.msg);
+    }
+  });
+
   it("Confirm removing a file deletes it", async () => {
     const { error0, error1, error2, error3, error4, fd, stat0, stat1 } = await page.evaluate(async () => {
       let { error: error0, fd } = window.Filesystem.open("/persistent/cursor.txt", "crw");
@@ -578,6 +648,18 @@ describe("Filesystem tests", () => {
     assert.deepStrictEqual(entries, [".", "..", "bin", "mydir"], "Read_dir returned incorrect entries");
   })
 
+  it("Read a directory with stats", async () => {
+    const { error0, entries, stats } = await page.evaluate(async () => {
+      let { error: error0, entries } = window.Filesystem.read_dir_plus("/persistent");
+      let stats = entries.map(({ name }) => window.Filesystem.stat("/persistent/" + name).stat);
+      return { error0, entries, stats };
+    });
+
+    assert.ok(error0 == null, "Read_dir_plus reported an error");
+    assert.deepStrictEqual(entries.map(({ name }) => name), [".", "..", "bin", "mydir"], "Read_dir_plus returned incorrect entries");
+    assert.deepStrictEqual(entries.map(({ stat }) => stat), stats, "Read_dir_plus stats should match a stat of each entry");
+  })
+
   it("Change active directory", async () => {
     const { error0, error1, error2, stat0, stat1 } = await page.evaluate(async () => {
       let { entries } = window.Filesystem.read_dir(".")
@@ -623,4 +705,35 @@ describe("Filesystem tests", () => {
       assert.ok(assertion.cond, assertion.msg);
     }
   });
+
+  it("Only rewrite system files that changed", async () => {
+    const assertions = await page.evaluate(async () => {
+      let assertions = [];
+      const FS = window._FSM.FS;
+
+      let manifest = JSON.parse(FS.readFile("/persistent/bin/.manifest.json", { encoding: "utf8" }));
+      let lsSize = FS.stat("/persistent/bin/ls.lua").size;
+      assertions.push({ cond: manifest["ls.lua"] !== undefined, msg: "manifest is missing ls.lua" });
+      assertions.push({ cond: manifest["ls.lua"].size === lsSize, msg: "manifest size doesn't match the file" });
+
+      // Booting again finds nothing to do
+      let mtime = FS.stat("/persistent/bin/ls.lua").mtime.getTime();
+      let { written, unchanged, removed } = window._FSM.bootstrapSystemFiles();
+      assertions.push({ cond: written === 0 && removed === 0, msg: "unchanged files were written again" });
+      assertions.push({ cond: unchanged === Object.keys(manifest).length, msg: "not every file was found unchanged" });
+      assertions.push({ cond: FS.stat("/persistent/bin/ls.lua").mtime.getTime() === mtime, msg: "ls.lua was rewritten" });
+
+      // A program lost from storage is put back, though the manifest matches
+      FS.unlink("/persistent/bin/ls.lua");
+      ({ written, unchanged, removed } = window._FSM.bootstrapSystemFiles());
+      assertions.push({ cond: written === 1 && removed === 0, msg: "only the missing file should be written" });
+      assertions.push({ cond: FS.stat("/persistent/bin/ls.lua").size === lsSize, msg: "ls.lua wasn't restored" });
+
+      return assertions;
+    });
+
+    for (let assertion of assertions) {
+      assert.ok(assertion.cond, assertion.msg);
+    }
+  });
 });
@@ -19,10 +19,36 @@ export function offsetof(M, structName, field) {
   return M.getValue(M[symbolName], 'i32');
 }
 
+// Fields are 4 bytes unless the module exports their size as
+// `sizeof_<struct>__<field>`, as it does for 64-bit ones
+export function fieldsize(M, structName, field) {
+  const symbol = M[`_sizeof_${structName}__${field}`];
+  if (symbol === undefined) {
+    return 4;
+  }
+  return M.getValue(symbol, 'i32');
+}
+
 export function derefi32(M, ptr, structName, field) {
   return M.getValue(ptr + offsetof(M, structName, field), 'i32');
 }
 
+// Structs are packed, so a 64-bit field may not be 8 byte aligned. It's read
+// as two halves, precise up to Number.MAX_SAFE_INTEGER
+export function derefi64(M, ptr, structName, field) {
+  const addr = ptr + offsetof(M, structName, field);
+  const low = M.getValue(addr, 'i32') >>> 0;
+  const high = M.getValue(addr + 4, 'i32');
+  return high * 0x100000000 + low;
+}
+
+export function deref(M, ptr, structName, field) {
+  if (fieldsize(M, structName, field) == 8) {
+    return derefi64(M, ptr, structName, field);
+  }
+  return derefi32(M, ptr, structName, field);
+}
+
 export class StructView {
   M;
   ptr;
@@ -36,13 +62,19 @@ export class StructView {
         if (prop in target) {
           return Reflect.get(target, prop, receiver);
         }
-        return derefi32(target.M, target.ptr, target.structName, prop);
+        return deref(target.M, target.ptr, target.structName, prop);
       },
       set(target, prop, newValue, receiver) {
         if (prop in target) {
           return Reflect.set(target, prop, newValue, receiver);
         }
-        M.setValue(target.ptr + target.offsetof(prop), newValue, 'i32');
+        const addr = target.ptr + target.offsetof(prop);
+        if (fieldsize(target.M, target.structName, prop) == 8) {
+          M.setValue(addr, newValue % 0x100000000, 'i32');
+          M.setValue(addr + 4, Math.floor(newValue / 0x100000000), 'i32');
+          return true;
+        }
+        M.setValue(addr, newValue, 'i32');
         return true;
       }
     });
@@ -0,0 +1,67 @@
+#include <emscripten/threading.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipe.h"
+
+_Static_assert(offsetof(Pipe, data) == 12, "Pipe must match the JS Pipe's control region");
+
+// Waits and wakes on the same words as the JS Pipe, with Atomics.wait and
+// Atomics.notify compatible futexes
+static void pipe__wait(_Atomic int32_t *word, int32_t value) {
+  emscripten_futex_wait(word, value, INFINITY);
+}
+
+static void pipe__wake(_Atomic int32_t *word, int count) {
+  emscripten_futex_wake(word, count);
+}
+
+Pipe *pipe__new(int capacity) {
+  Pipe *pipe = malloc(sizeof(Pipe) + capacity);
+  if (pipe == NULL) return NULL;
+  atomic_init(&pipe->read, 0);
+  atomic_init(&pipe->write, 0);
+  atomic_init(&pipe->capacity, capacity);
+  return pipe;
+}
+
+void pipe__write(Pipe *restrict pipe, const char *restrict buf, int len, Error *restrict err) {
+  const int cap = atomic_load(&pipe->capacity);
+  int at = 0;
+  while (at < len) {
+    const int32_t state = atomic_load(&pipe->write);
+    if (state & PIPE_CLOSED) {
+      *err = -13; // Failed to write to stdout (errors.c)
+      return;
+    }
+    const int wr = state & PIPE_POINTER;
+    const int rd = atomic_load(&pipe->read);
+
+    const int room = (rd - wr - 1 + cap) % cap;
+    if (room == 0) {
+      // Buffer full; wait on the read pointer
+      pipe__wait(&pipe->read, rd);
+      continue;
+    }
+
+    // Copy as much as fits in one go, in two parts if it wraps past the end
+    const int n = room < len - at ? room : len - at;
+    const int head = n < cap - wr ? n : cap - wr;
+    memcpy(pipe->data + wr, buf + at, head);
+    if (n > head) memcpy(pipe->data, buf + at + head, n - head);
+    at += n;
+
+    // Moved by the difference, so a close flagged meanwhile isn't lost
+    atomic_fetch_add(&pipe->write, (wr + n) % cap - wr);
+    pipe__wake(&pipe->write, 1);
+  }
+  *err = 0;
+}
+
+void pipe__close(Pipe *pipe) {
+  atomic_fetch_or(&pipe->write, PIPE_CLOSED);
+  // Every reader waiting on more data is done
+  pipe__wake(&pipe->write, INT32_MAX);
+}
@@ -0,0 +1,38 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#ifndef MAIN_H
+typedef int Error;
+#endif
+
+// Set in `write` once the pipe has been closed by its writer
+#define PIPE_CLOSED (1 << 30)
+#define PIPE_POINTER (PIPE_CLOSED - 1)
+
+// A pipe whose ring buffer lives in WASM memory, so the process owning that
+// memory can use it without calling out to JS. It's laid out exactly like the
+// SharedArrayBuffer behind a JS Pipe (src/pipe.mjs), and waits and wakes on
+// the same words, so the reading end is a JS Pipe over the memory at the
+// pipe's address. One slot is kept empty to distinguish full from empty.
+typedef struct {
+  _Atomic int32_t read;     // 0
+  _Atomic int32_t write;    // 4, with PIPE_CLOSED set once closed
+  _Atomic int32_t capacity; // 8
+  unsigned char data[];     // 12
+} Pipe;
+
+// Allocates a pipe holding up to `capacity` - 1 bytes. It's never freed, as
+// the other end may outlive the process. Returns NULL if out of memory
+Pipe *pipe__new(int capacity);
+
+// Copies all of `buf` into the pipe, blocking while it's full.
+// Fails if the pipe is closed, even part way through
+void pipe__write(Pipe *restrict pipe, const char *restrict buf, int len, Error *restrict err);
+
+// Marks the end of the data written so far, never blocks
+void pipe__close(Pipe *pipe);
+
+#endif
@@ -9,6 +9,8 @@
 #include <unistd.h>
 
 #include "../../filesystem/src/file.h"
+#include "../../filesystem/src/scan.h"
+#include "pipe.h"
 #include "processes.h"
 
 // void proc__close_input(Error *err);
@@ -17,8 +19,8 @@ EM_JS(void, proc__close_input, (Error *err), {
   setValue(err, 0, 'i32');
 })
 
-// void proc__close_output(Error *err);
-EM_JS(void, proc__close_output, (Error *err), {
+// void proc__close_output_js(Error *err);
+EM_JS(void, proc__close_output_js, (Error *err), {
   self.proc.stdout.close();
   setValue(err, 0, 'i32');
 })
@@ -29,32 +31,46 @@ EM_JS(void, proc__close_error, (Error *err), {
   setValue(err, 0, 'i32');
 })
 
+// Pipe I/O copies straight between HEAPU8 and the pipe's SharedArrayBuffer,
+// no JS strings are made on the way
+
 // int proc__input_pipe(char* buf, int max_bytes, Error *err);
 EM_JS(int, proc__input_pipe,
       (char *restrict buf, int max_bytes, Error *restrict err), {
-        let s = self.proc.input(max_bytes - 1); // -1 for null terminator
-        stringToUTF8(s, buf, max_bytes);
+        let n = self.proc.input(HEAPU8, buf, max_bytes - 1); // -1 for null terminator
+        HEAPU8[buf + n] = 0;
+        setValue(err, 0, 'i32');
+        return n + 1; // +1 for null terminator
+      })
+
+// int proc__input_bytes_pipe(char *buf, int max_bytes, Error *err);
+EM_JS(int, proc__input_bytes_pipe,
+      (char *restrict buf, int max_bytes, Error *restrict err), {
+        let n = self.proc.input(HEAPU8, buf, max_bytes);
         setValue(err, 0, 'i32');
-        return s.length + 1; // +1 for null terminator
+        return n;
       })
 
 // int proc__input_exact_pipe(char *buf, int exact_byes, Error *err);
 EM_JS(int, proc__input_exact_pipe,
       (char *restrict buf, int exact_bytes, Error *restrict err), {
-        let s = self.proc.inputExact(exact_bytes - 1); // -1 for null terminator
-        stringToUTF8(s, buf, exact_bytes);
+        let n = self.proc.inputExact(HEAPU8, buf, exact_bytes - 1); // -1 for null terminator
+        HEAPU8[buf + n] = 0;
         setValue(err, 0, 'i32');
-        return s.length + 1; // +1 for null terminator
+        return n + 1; // +1 for null terminator
       })
 
 // WARNING: BUF MUST BE FREED
 // char *proc__input_all_pipe(Error *err)
 EM_JS(char *, proc__input_all_pipe, (Error * err), {
-  const ptr = stringToNewUTF8(self.proc.inputAll());
+  const bytes = self.proc.inputAll();
+  const ptr = _malloc(bytes.length + 1);
   if (!ptr) {
     setValue(err, -18, 'i32'); // -18 is ENOMEM (errors.c)
     return null;
   }
+  HEAPU8.set(bytes, ptr);
+  HEAPU8[ptr + bytes.length] = 0;
   setValue(err, 0, 'i32');
   return ptr;
 })
@@ -62,11 +78,14 @@ EM_JS(char *, proc__input_all_pipe, (Error * err), {
 // WARNING: BUF MUST BE FREED
 // char *proc__input_line_pipe(Error *err)
 EM_JS(char *, proc__input_line_pipe, (Error * err), {
-  const ptr = stringToNewUTF8(self.proc.inputLine());
+  const bytes = self.proc.inputLine();
+  const ptr = _malloc(bytes.length + 1);
   if (!ptr) {
     setValue(err, -18, 'i32'); // -18 is ENOMEM (errors.c)
     return null;
   }
+  HEAPU8.set(bytes, ptr);
+  HEAPU8[ptr + bytes.length] = 0;
   setValue(err, 0, 'i32');
   return ptr;
 })
@@ -74,18 +93,15 @@ EM_JS(char *, proc__input_line_pipe, (Error * err), {
 // proc__output_pipe(char* buf, int len, Error *err)
 EM_JS(void, proc__output_pipe,
       (const char *restrict buf, int len, Error *restrict err), {
-        var s = UTF8ToString(buf, len);
-        self.proc.output(s);
+        self.proc.output(HEAPU8.subarray(buf, buf + len));
         setValue(err, 0, 'i32');
       })
 
 // proc__error_pipe(char* buf, int len, Error *err)
 EM_JS(void, proc__error_pipe,
       (const char *restrict buf, int len, Error *restrict err), {
-        var s = UTF8ToString(buf, len);
-        self.proc.error(s);
+        self.proc.error(HEAPU8.subarray(buf, buf + len));
         setValue(err, 0, 'i32');
-        return s.length;
       })
 
 // proc__wait(int pid, Error *err)
@@ -97,12 +113,14 @@ EM_JS(int, proc__wait, (int pid, Error *err), {
 
 // proc__create(const char *restrict buf, int len, const char *restrict *args,
 // int args_len, bool pipe_stdin, bool pipe_stdout, const char *restrict
-// redirect_in, const char *restrict redirect_out, Error *restrict err)
+// redirect_in, const char *restrict redirect_out, const char *restrict cwd,
+// int pipe_size, int pipe_max, bool heap_pipe, Error *restrict err)
 EM_JS(int, proc__create,
       (const char *restrict buf, int len, const char *restrict *args,
        int args_len, bool pipe_stdin, bool pipe_stdout,
        const char *restrict redirect_in, const char *restrict redirect_out,
-       const char *restrict cwd, Error *restrict err),
+       const char *restrict cwd, int pipe_size, int pipe_max, bool heap_pipe,
+       Error *restrict err),
       {
         let jsArgs = [];
         for (let i = 0; i < args_len; i++) {
@@ -114,7 +132,8 @@ EM_JS(int, proc__create,
         let jsCwd = UTF8ToString(cwd);
         let createdPID =
             self.proc.create(luaPath, jsArgs, Boolean(pipe_stdin),
-                             Boolean(pipe_stdout), redirectIn, redirectOut, jsCwd);
+                             Boolean(pipe_stdout), redirectIn, redirectOut, jsCwd,
+                             pipe_size, pipe_max, Boolean(heap_pipe));
         if (createdPID < 0) {
           setValue(err, createdPID, 'i32'); // Just forward error from JS
           return -1;
@@ -176,6 +195,12 @@ EM_JS(char *, proc__get_redirect_out, (Error * err), {
   return ptr;
 })
 
+// proc__get_stdout_ring(Error *err)
+EM_JS(Pipe *, proc__get_stdout_ring, (Error * err), {
+  setValue(err, 0, 'i32');
+  return self.proc.stdoutRing;
+})
+
 // proc__pipe(int out_pid, int in_pid, Error *err)
 EM_JS(void, proc__pipe, (int out_pid, int in_pid, Error *err), {
   let errCode = self.proc.pipe(out_pid, in_pid);
@@ -234,6 +259,46 @@ int proc__input(char *restrict buf, int max_bytes, Error *restrict err) {
   return (int)bytesRead;
 }
 
+// Input redirected from a file is read through one descriptor, so binary
+// reads carry on from where the last one stopped
+char *_redir_in_name;
+int _redir_in_fd = -1;
+
+int proc__input_bytes(char *restrict buf, int max_bytes, Error *restrict err) {
+  // Short-circuit evaluation as to where we take input
+  //  1. File
+  //  2. Pipe
+  //  3. Stdin
+
+  // Check and take from file
+  if (_redir_in_name == NULL) _redir_in_name = proc__get_redirect_in(err);
+  if (_redir_in_name[0] != '\0') {
+    if (_redir_in_fd == -1) {
+      _redir_in_fd = file__open(_redir_in_name, O_RDONLY, err);
+      if (_redir_in_fd == -1) return -1;
+    }
+    return file__read_chunk(_redir_in_fd, buf, max_bytes, err);
+  }
+
+  // Check and take from pipe
+  if (proc__is_stdin_pipe(err)) {
+    if (*err != 0) {
+      return -1;
+    }
+    return proc__input_bytes_pipe(buf, max_bytes, err);
+  }
+
+  // Take from stdin
+  size_t bytesRead = fread(buf, 1, max_bytes, stdin);
+  if (ferror(stdin)) {
+    *err = -14; // failed to read stdin (errors.c)
+    return -1;
+  }
+
+  *err = 0;
+  return (int)bytesRead;
+}
+
 // NOT USED
 int proc__input_exact(char *restrict buf, int exact_bytes,
                       Error *restrict err) {
@@ -308,13 +373,22 @@ char *proc__input_all(Error *err) {
   char *file_redirect = proc__get_redirect_in(err);
   if (file_redirect[0] != '\0') {
     int fd = file__open(file_redirect, O_RDONLY, err);
+    free(file_redirect);
     if (fd == -1)
       return NULL;
+    // file__read_all sizes its buffer from fstat and NUL terminates it,
+    // so it can be handed straight back
     ReadResult rr;
     file__read_all(fd, &rr, err);
+    if (*err != 0) {
+      Error close_err;
+      file__close(fd, &close_err);
+      return NULL;
+    }
     file__close(fd, err);
     return rr.data;
   }
+  free(file_redirect);
 
   // Check and take from pipe
   if (proc__is_stdin_pipe(err)) {
@@ -324,24 +398,22 @@ char *proc__input_all(Error *err) {
     return proc__input_all_pipe(err);
   }
 
-  // Take input from stdin
+  // Take input from stdin, a chunk at a time
 
-  // Initial size
-  size_t capacity = 1024;
+  size_t capacity = CHUNK_SIZE;
   size_t length = 0;
-  char *buffer = malloc(capacity);
+  char *buffer = malloc(capacity + 1); // +1 for null terminator
   if (!buffer) {
     *err = -18; // Failed to assign memory (errors.c)
     return NULL;
   }
 
-  int c;
-  while ((c = getchar()) != EOF) {
+  while (true) {
     // If we need to expand buffer
-    if (length + 1 >= capacity) {
+    if (length == capacity) {
       // double it
       capacity *= 2;
-      char *temp = realloc(buffer, capacity);
+      char *temp = realloc(buffer, capacity + 1);
       if (!temp) {
         free(buffer);
         *err = -18; // Failed to assign memory (errors.c)
@@ -349,7 +421,16 @@ char *proc__input_all(Error *err) {
       }
       buffer = temp;
     }
-    buffer[length++] = (char)c;
+
+    size_t n = fread(buffer + length, 1, capacity - length, stdin);
+    length += n;
+    if (n == 0 || feof(stdin)) break;
+  }
+
+  if (ferror(stdin)) {
+    free(buffer);
+    *err = -14; // failed to read stdin (errors.c)
+    return NULL;
   }
 
   // Null terminate
@@ -398,9 +479,110 @@ char *proc__input_line(Error *err) {
   return lineptr;
 }
 
+// Output redirected to a file is written in place, so it can be followed
+// while the process runs. Whatever is still buffered (up to the buffer's size,
+// OUTPUT_BUFFER_SIZE by default) is lost if the process is killed
 int _redir_fd = -1;
 char *_redir_name;
 
+// Write-back buffer for output redirected to a file, so many small outputs
+// become a few large writes. Policies mirror setvbuf: _IOFBF flushes when
+// full, _IOLBF also sends every complete line, _IONBF writes straight through
+struct {
+  char *data; // allocated on first buffered write
+  int len;
+  int size;
+  int mode;
+} _redir_buf = {NULL, 0, OUTPUT_BUFFER_SIZE, _IOFBF};
+
+void proc__flush_output(Error *err) {
+  if (_redir_fd != -1 && _redir_buf.len > 0) {
+    // Kept on failure, so a later flush can try again
+    file__write_n(_redir_fd, _redir_buf.data, _redir_buf.len, err);
+    if (*err == 0) _redir_buf.len = 0;
+    return;
+  }
+  *err = 0;
+}
+
+void proc__set_output_buffering(int mode, int size, Error *err) {
+  if ((mode != _IOFBF && mode != _IOLBF && mode != _IONBF) || size < 0) {
+    *err = E_INVALID;
+    return;
+  }
+
+  // Anything pending was buffered under the old policy
+  proc__flush_output(err);
+  if (*err != 0) return;
+
+  free(_redir_buf.data);
+  _redir_buf.data = NULL;
+  _redir_buf.mode = mode;
+  _redir_buf.size = size > 0 ? size : OUTPUT_BUFFER_SIZE;
+  *err = 0;
+}
+
+static void proc__output_redirect(const char *restrict buf, int len, Error *restrict err) {
+  if (_redir_buf.mode == _IONBF) {
+    file__write_n(_redir_fd, buf, len, err);
+    return;
+  }
+
+  if (_redir_buf.data == NULL) {
+    _redir_buf.data = malloc(_redir_buf.size);
+    // Can still get the output out, just without buffering
+    if (_redir_buf.data == NULL) {
+      file__write_n(_redir_fd, buf, len, err);
+      return;
+    }
+  }
+
+  if (_redir_buf.len + len > _redir_buf.size) {
+    // Doesn't fit, send what's pending and this together in one write
+    WriteSlice slices[] = {
+      {_redir_buf.data, _redir_buf.len},
+      {buf, len},
+    };
+    file__writev(_redir_fd, slices, 2, err);
+    if (*err == 0) _redir_buf.len = 0;
+    return;
+  }
+
+  memcpy(_redir_buf.data + _redir_buf.len, buf, len);
+  _redir_buf.len += len;
+
+  if (_redir_buf.len == _redir_buf.size) {
+    proc__flush_output(err);
+    return;
+  }
+
+  // Line buffered sends every complete line, and holds on to an unfinished one
+  const char *last_newline = _redir_buf.mode == _IOLBF ? scan__memrchr(buf, '\n', len) : NULL;
+  if (last_newline != NULL) {
+    int upto = _redir_buf.len - len + (last_newline - buf) + 1;
+    file__write_n(_redir_fd, _redir_buf.data, upto, err);
+    if (*err != 0) return;
+    memmove(_redir_buf.data, _redir_buf.data + upto, _redir_buf.len - upto);
+    _redir_buf.len -= upto;
+    return;
+  }
+  *err = 0;
+}
+
+// Piped stdout living in this module's memory is written from C, see pipe.h.
+// It's looked up once, after which output never has to call out to JS
+Pipe *_stdout_ring;
+bool _stdout_ring_checked = false;
+
+static Pipe *proc__stdout_ring(void) {
+  if (!_stdout_ring_checked) {
+    Error err;
+    _stdout_ring = proc__get_stdout_ring(&err);
+    _stdout_ring_checked = true;
+  }
+  return _stdout_ring;
+}
+
 void proc__output(const char *restrict buf, int len, Error *restrict err) {
   // Short-circuit evaluation as to where we direct output
   //  1. File
@@ -413,18 +595,24 @@ void proc__output(const char *restrict buf, int len, Error *restrict err) {
     if (_redir_name[0] != '\0') {
       _redir_fd = file__open(_redir_name, O_CREAT | O_WRONLY, err);
       if (_redir_fd == -1 && *err == E_EXISTS) {
-        _redir_fd = file__open(_redir_name, O_WRONLY, err);
+        // Truncated, so shorter output doesn't leave the old file's tail
+        _redir_fd = file__open(_redir_name, O_WRONLY | O_TRUNC, err);
       }
       if (_redir_fd == -1) return;
     }
   }
 
   if (_redir_fd != -1) {
-    file__write(_redir_fd, buf, err);
+    proc__output_redirect(buf, len, err);
     return;
   }
 
-  // Check if it's a pipe
+  // Check if it's a pipe, in our own memory first
+  Pipe *ring = proc__stdout_ring();
+  if (ring != NULL) {
+    pipe__write(ring, buf, len, err);
+    return;
+  }
   if (proc__is_stdout_pipe(err)) {
     if (*err != 0) {
       return;
@@ -459,11 +647,29 @@ EM_JS(char *, proc__get_lua_code, (Error * err), {
   return ptr;
 })
 
-EM_JS(void, proc__exit, (int exit_code, Error *err), {
+EM_JS(void, proc__exit_js, (int exit_code, Error *err), {
   self.proc.exit(exit_code);
   setValue(err, 0, 'i32');
 })
 
+void proc__exit(int exit_code, Error *err) {
+  // Exit regardless, there's no one left to report a failed flush to
+  Error flush_err;
+  proc__flush_output(&flush_err);
+  proc__exit_js(exit_code, err);
+}
+
+void proc__close_output(Error *err) {
+  proc__flush_output(err);
+  if (*err != 0) return;
+  Pipe *ring = proc__stdout_ring();
+  if (ring != NULL) {
+    pipe__close(ring);
+    return;
+  }
+  proc__close_output_js(err);
+}
+
 // WARNING: NEED TO CLEAR ARGV IN C
 // void proc__args(int *argc, char ***argv, Error *err);
 EM_JS(void, proc__args,
@@ -2,10 +2,18 @@
 #include <stdbool.h>
 #define PROCESSES_H
 
+#include "pipe.h"
+
 #ifndef MAIN_H
 typedef int Error;
 #endif
 
+// Default size of the write-back buffer used when output is redirected to a file
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+// Largest capacity a process' pipes can be created with, or grow to
+#define PIPE_SIZE_MAX (64 * 1024 * 1024)
+
 typedef enum { READY, RUNNING, SLEEPING, TERMINATING, STARTING } ProcessState;
 
 typedef struct __attribute__((packed)) {
@@ -21,7 +29,9 @@ int proc__input_pipe(char *restrict buf, int max_bytes, Error *restrict err); //
 char *proc__input_all_pipe(Error *err); // WARNING: MUST FREE OUTPARAM `BUF` // INFO: Not meant to be used directly, used by `proc__input_all`
 char *proc__input_line_pipe(Error *err); // WARNING: MUST FREE OUTPARAM `BUF` // INFO: Not meant to be used directly, used by `proc__input_line`
 int proc__input_exact_pipe(char *restrict buf, int exact_bytes, Error *restrict err); // INFO: Not meant to be used directly, used by `proc__input_exact`
+int proc__input_bytes_pipe(char *restrict buf, int max_bytes, Error *restrict err); // INFO: Not meant to be used directly, used by `proc__input_bytes`
 int proc__input(char *restrict buf, int max_bytes, Error *restrict err);
+int proc__input_bytes(char *restrict buf, int max_bytes, Error *restrict err); // INFO: Binary safe, isn't NUL terminated. Returns the bytes read, 0 on EOF
 int proc__input_exact(char *restrict buf, int exact_bytes, Error *err);
 char *proc__input_all(Error *err); // WARNING: MUST FREE OUTPARAM `BUF`
 char *proc__input_line(Error *err); // WARNING: MUST FREE OUTPARAM `BUF`
@@ -30,7 +40,9 @@ void proc__close_input(Error *err);
 // Output
 void proc__output_pipe(const char *restrict buf, int len, Error *restrict err);
 void proc__output(const char *restrict buf, int len, Error *restrict err);
-void proc__close_output(Error *err);
+void proc__close_output(Error *err); // INFO: Flushes buffered output first
+void proc__flush_output(Error *err);
+void proc__set_output_buffering(int mode, int size, Error *err); // INFO: `mode` is one of setvbuf's _IOFBF, _IOLBF or _IONBF, `size` 0 keeps the default
 
 // Error
 void proc__error_pipe(const char *restrict buf, int len, Error *restrict err);
@@ -40,9 +52,10 @@ void proc__close_error(Error *err);
 void proc__pipe(int out_pid, int in_pid, Error *err);
 bool proc__is_stdout_pipe(Error *err);
 bool proc__is_stdin_pipe(Error *err);
+Pipe *proc__get_stdout_ring(Error *err); // INFO: NULL unless stdout is a pipe in this module's memory, used by `proc__output`
 
 // Processes
-int proc__create(const char *restrict buf, int len, const char *restrict *args, int args_len, bool pipe_stdin, bool pipe_stdout, const char *restrict redirect_in, const char *restrict redirect_out, const char *restrict cwd, Error *restrict err);
+int proc__create(const char *restrict buf, int len, const char *restrict *args, int args_len, bool pipe_stdin, bool pipe_stdout, const char *restrict redirect_in, const char *restrict redirect_out, const char *restrict cwd, int pipe_size, int pipe_max, bool heap_pipe, Error *restrict err);
 int proc__wait(int pid, Error *err);
 void proc__kill(int pid, Error *err);
 Process* proc__list(int *restrict length, Error *restrict err); // WARNING: PROCESS* RETURN VALUE MUST BE FREED
@@ -50,7 +63,7 @@ int proc__get_pid(Error *err);
 char *proc__get_redirect_in(Error *err);
 char *proc__get_redirect_out(Error *err);
 void proc__start(int pid, Error *err);
-void proc__exit(int exit_code, Error *err);
+void proc__exit(int exit_code, Error *err); // INFO: Flushes buffered output first
 void proc__args(int *restrict argc, char *restrict **argv, Error *restrict err); // WARNING: MUST FREE OUTPARAM `ARGV`
 char *proc__get_lua_code(Error *err);
 
@@ -1,26 +1,81 @@
+// Control region: read pointer, write pointer and the current capacity
+const HEADER = 12;
+// Set in the write pointer's word once the writer has closed the pipe. Sharing
+// the word means a reader waiting on it is woken by a close as well as data,
+// and always sees the close together with the last byte written before it.
+const CLOSED = 1 << 30;
+const POINTER = CLOSED - 1;
+// Times the writer has to block on a full pipe before an adaptive one grows
+const GROW_AFTER = 4;
+
 export default class Pipe {
-  #EOF = 0xFF; // EOF is 255 as we're bound to 8 bits - hopefully OK with ascii/utf8
-  #closed = false;
+  #fullWaits = 0;
 
   /**
    * Create a Pipe that uses a SharedArrayBuffer.
    * @param {number} size The capacity of the data region.
    * @param {SharedArrayBuffer|null} buffer Optionally provide an existing buffer.
+   * @param {number} maxSize If larger than `size`, the pipe is adaptive and
+   *   doubles its capacity, up to `maxSize`, when the writer keeps blocking on
+   *   a full pipe.
+   * @param {number} offset Where the pipe starts in `buffer`, for a pipe living
+   *   inside a larger buffer such as a process's WASM memory (see pipe.h).
    */
-  constructor(size, buffer = null) {
-    // Allocate extra 8 bytes for control (read and write pointers)
+  constructor(size, buffer = null, maxSize = size, offset = 0) {
     // One slot is kept empty to distinguish full from empty.
-    this.attachBuffer(buffer || new SharedArrayBuffer(size + 8));
+    if (buffer === null) {
+      // Engines without growable SharedArrayBuffers ignore the options and
+      // hand back a fixed one, which just never grows
+      buffer = maxSize > size
+        ? new SharedArrayBuffer(HEADER + size, { maxByteLength: HEADER + maxSize })
+        : new SharedArrayBuffer(HEADER + size);
+      Atomics.store(new Int32Array(buffer, 0, 3), 2, size);
+    }
+    this.attachBuffer(buffer, offset);
     this.encoder = new TextEncoder();
     this.decoder = new TextDecoder();
+
+    // Number of times either end was put to sleep and woken by the other
+    this.wakeups = 0;
   }
 
-  attachBuffer(buffer) {
+  attachBuffer(buffer, offset = 0) {
     this.buffer = buffer;
-    // Use an Int32Array for the control region (2 integers: read and write pointers)
-    this.control = new Int32Array(this.buffer, 0, 2);
-    // Data region starts at byte offset 8.
-    this.data = new Uint8Array(this.buffer, 8, this.buffer.byteLength - 8);
+    this.offset = offset;
+    // Use an Int32Array for the control region (read and write pointers, capacity)
+    this.control = new Int32Array(this.buffer, offset, 3);
+    this.data = new Uint8Array(this.buffer, offset + HEADER, Atomics.load(this.control, 2));
+  }
+
+  /**
+   * Picks up a capacity grown by the writer. It's published before the write
+   * pointer ever moves past the old capacity, so checking after loading the
+   * write pointer is enough to cover every byte it says is readable.
+   */
+  #syncCapacity() {
+    const capacity = Atomics.load(this.control, 2);
+    if (capacity !== this.data.length) {
+      this.data = new Uint8Array(this.buffer, this.offset + HEADER, capacity);
+    }
+  }
+
+  /**
+   * Doubles the capacity of an adaptive pipe. Only safe while the readable
+   * bytes don't wrap past the end of the ring, as they then keep their
+   * positions in the larger one.
+   */
+  #grow() {
+    this.#fullWaits = 0;
+    if (!this.buffer.growable) return;
+    const capacity = Math.min(this.data.length * 2, this.buffer.maxByteLength - this.offset - HEADER);
+    if (capacity <= this.data.length) return;
+    this.buffer.grow(this.offset + HEADER + capacity);
+    this.data = new Uint8Array(this.buffer, this.offset + HEADER, capacity);
+    Atomics.store(this.control, 2, capacity);
+  }
+
+  #wait(index, value) {
+    if (Atomics.wait(this.control, index, value) === "ok") this.wakeups++;
   }
 
   // Return the underlying SharedArrayBuffer.
@@ -28,31 +83,56 @@ export default class Pipe {
     return this.buffer;
   }
 
-  #writeEOF() {
-    if (this.#closed) return -1;
-    while (true) {
-      const wr = Atomics.load(this.control, 1);
+  /**
+   * Marks the end of the data written so far. Nothing is written to the
+   * ring, so this never blocks on a full pipe.
+   */
+  close() {
+    Atomics.or(this.control, 1, CLOSED);
+    // Every reader waiting on more data is done
+    Atomics.notify(this.control, 1);
+  }
+
+  isClosed() {
+    return (Atomics.load(this.control, 1) & CLOSED) !== 0;
+  }
+
+  /**
+   * Copies `bytes` into the ring as contiguous spans. A span is whatever fits
+   * before the read pointer, copied in at most two parts when it wraps past
+   * the end, and published with a single update and notify.
+   */
+  #copyIn(bytes) {
+    let at = 0;
+    while (at < bytes.length) {
+      const wr = Atomics.load(this.control, 1) & POINTER;
       const rd = Atomics.load(this.control, 0);
-      if (((wr + 1) % this.data.length) === rd) {
-        Atomics.wait(this.control, 0, rd);
+      this.#syncCapacity();
+      // Grow once the writer has been held up enough, at a point where the
+      // readable bytes run straight from the read to the write pointer
+      if (this.#fullWaits >= GROW_AFTER && rd <= wr) this.#grow();
+
+      const len = this.data.length;
+      // One slot is kept empty, so the ring is full one byte behind the reader
+      const free = (rd - wr - 1 + len) % len;
+      if (free === 0) {
+        // Buffer full; wait on the read pointer
+        this.#fullWaits++;
+        this.#wait(0, rd);
         continue;
       }
-      this.data[wr] = this.#EOF;
-      const newWr = (wr + 1) % this.data.length;
-      Atomics.store(this.control, 1, newWr);
-      Atomics.notify(this.control, 1, 1);
-      break;
-    }
-    return 0;
-  }
 
-  close() {
-    this.#writeEOF();
-    this.#closed = true;
-  }
+      const n = Math.min(free, bytes.length - at);
+      const head = Math.min(n, len - wr);
+      this.data.set(bytes.subarray(at, at + head), wr);
+      if (n > head) this.data.set(bytes.subarray(at + head, at + n), 0);
+      at += n;
 
-  isClosed() {
-    return this.#closed;
+      // Moved by the difference, so a close flagged meanwhile isn't lost
+      Atomics.add(this.control, 1, (wr + n) % len - wr);
+      // Notify the reader that new data is available
+      Atomics.notify(this.control, 1, 1);
+    }
   }
 
   /**
@@ -60,159 +140,183 @@ export default class Pipe {
    * Returns -1 if closed, 0 otherwise
    */
   write(data) {
-    if (this.#closed) return -1;
-
-    const encoded = this.encoder.encode(data);
-    for (let i = 0; i < encoded.length; i++) {
-      while (true) {
-        const wr = Atomics.load(this.control, 1);
-        const rd = Atomics.load(this.control, 0);
-        // Buffer is full if the next write index equals the read pointer
-        if (((wr + 1) % this.data.length) === rd) {
-          // Buffer full; wait on the read pointer
-          Atomics.wait(this.control, 0, rd);
-          continue;
-        }
-        // Write the byte at the current write pointer
-        this.data[wr] = encoded[i];
-        const newWr = (wr + 1) % this.data.length;
-        Atomics.store(this.control, 1, newWr);
-        // Notify the reader that new data is available
-        Atomics.notify(this.control, 1, 1);
-        break;
-      }
-    }
-    return 0;
+    return this.writeBytes(this.encoder.encode(data));
   }
 
   /**
-  * Blocks until it has read `exactBytes` of data
-  */
-  readExact(exactBytes) {
-    const result = [];
-
-    // Read up to maxBytes
-    for (let i = 0; i < exactBytes;) {
-      const rd = Atomics.load(this.control, 0);
-      const wr = Atomics.load(this.control, 1);
-      // 
-      // If buffer is full, wait
-      if (rd === wr) {
-        Atomics.wait(this.control, 1, wr);
-        continue;
-      }
-
-      // If buffer is empty or EOF stop
-      if (this.data[rd] === this.#EOF) break;
-
-      // Otherwise read one byte
-      result.push(this.data[rd]);
-      i++;
+   * Writes raw bytes to buffer, any value is passed through.
+   * Returns -1 if closed, 0 otherwise
+   */
+  writeBytes(bytes) {
+    if (this.isClosed()) return -1;
+    this.#copyIn(bytes);
+    return 0;
+  }
 
-      // Advance read pointer
-      let newRd = (rd + 1) % this.data.length;
-      Atomics.store(this.control, 0, newRd);
-      Atomics.notify(this.control, 0, 1);
+  // Blocks until there's at least 1 byte to read or the pipe is closed
+  #waitForData() {
+    while (true) {
+      const state = Atomics.load(this.control, 1);
+      if ((state & CLOSED) || Atomics.load(this.control, 0) !== state) return;
+      // Buffer empty; wait on the write pointer
+      this.#wait(1, state);
     }
-    return this.decoder.decode(new Uint8Array(result));
   }
 
   /**
-  * Blocks until at least 1 byte is available, and then
-  * tries to read up to `max_bytes` or EOF
-  */
-  read(maxBytes) {
-    const result = [];
+   * Hands up to `max` of the bytes readable right now to `copy`, as at most
+   * two spans (before and after the ring wraps), stopping just after a
+   * newline when `line` is set. The spans are views of shared memory, only
+   * valid until `copy` returns. The read pointer is advanced and the writer
+   * notified once per batch. `done` is set once the newline or the end of a
+   * closed pipe has been reached.
+   */
+  #take(max, copy, line = false) {
+    const state = Atomics.load(this.control, 1);
+    const wr = state & POINTER;
+    this.#syncCapacity();
+    const len = this.data.length;
+    let rd = Atomics.load(this.control, 0);
+    let taken = 0;
+    let newline = false;
 
-    // Block until we have at least 1 byte or EOF
-    while (true) {
-      const rd = Atomics.load(this.control, 0);
-      const wr = Atomics.load(this.control, 1);
+    while (!newline && taken < max && rd !== wr) {
+      const span = this.data.subarray(rd, wr > rd ? wr : len);
+      let take = Math.min(span.length, max - taken);
 
-      if (rd !== wr) {
-        // There's atleast 1 byte
-        break;
+      const at = line ? span.subarray(0, take).indexOf(10) : -1;
+      if (at !== -1) {
+        take = at + 1;
+        newline = true;
       }
 
-      // Wait until there's something to read
-      Atomics.wait(this.control, 1, wr);
+      copy(span.subarray(0, take));
+      taken += take;
+      rd = (rd + take) % len;
     }
 
-    // Read up to maxBytes
-    for (let i = 0; i < maxBytes; i++) {
-      const rd = Atomics.load(this.control, 0);
-      const wr = Atomics.load(this.control, 1);
-
-      // If buffer is empty or EOF stop
-      if (this.data[rd] === this.#EOF || rd === wr) break;
+    if (taken > 0) {
+      Atomics.store(this.control, 0, rd);
+      Atomics.notify(this.control, 0, 1);
+    }
+    return { taken, done: newline || (rd === wr && (state & CLOSED) !== 0) };
+  }
 
-      // Otherwise read one byte
-      result.push(this.data[rd]);
+  // TextDecoder won't decode views of shared memory, so spans are copied out
+  #copyOut(parts) {
+    return (span) => parts.push(span.slice());
+  }
 
-      // Advance read pointer
-      let newRd = (rd + 1) % this.data.length;
-      Atomics.store(this.control, 0, newRd);
-      Atomics.notify(this.control, 0, 1);
+  #concat(parts) {
+    if (parts.length === 1) return parts[0];
+    let length = 0;
+    for (const part of parts) length += part.length;
+    const result = new Uint8Array(length);
+    let offset = 0;
+    for (const part of parts) {
+      result.set(part, offset);
+      offset += part.length;
     }
-    return this.decoder.decode(new Uint8Array(result));
+    return result;
+  }
+
+  // Reads into a fresh array until `done`
+  #takeUntilDone(line) {
+    const parts = [];
+    const copy = this.#copyOut(parts);
+    do {
+      this.#waitForData();
+    } while (!this.#take(Infinity, copy, line).done);
+    return this.#concat(parts);
+  }
+
+  // Copies spans straight into `target` from `offset` on
+  #copyTo(target, offset) {
+    return (span) => {
+      target.set(span, offset);
+      offset += span.length;
+    };
   }
 
   /**
-  * Reads until EOF
+  * Blocks until at least 1 byte is available, and then copies up to
+  * `maxBytes`, or up to EOF, into `target` (any Uint8Array, e.g. a WASM heap)
+  * at `offset`. Returns the number of bytes copied, 0 meaning EOF
   */
-  readAll() {
-    const result = []
-    while (true) {
-      const rd = Atomics.load(this.control, 0);
-      const wr = Atomics.load(this.control, 1);
-
-      // If buffer is full, wait
-      if (rd === wr) {
-        Atomics.wait(this.control, 1, wr);
-        continue;
-      }
+  readInto(target, offset, maxBytes) {
+    this.#waitForData();
+    return this.#take(maxBytes, this.#copyTo(target, offset)).taken;
+  }
 
-      // Only break on EOF
-      if (this.data[rd] == this.#EOF) return this.decoder.decode(new Uint8Array(result));
-      result.push(this.data[rd]);
-      const newRd = (rd + 1) % this.data.length;
-      Atomics.store(this.control, 0, newRd);
-      Atomics.notify(this.control, 0, 1);
+  /**
+  * Blocks until `exactBytes` have been copied into `target` at `offset`, or
+  * EOF. Returns the number of bytes copied
+  */
+  readExactInto(target, offset, exactBytes) {
+    const copy = this.#copyTo(target, offset);
+    let i = 0;
+    while (i < exactBytes) {
+      this.#waitForData();
+      const { taken, done } = this.#take(exactBytes - i, copy);
+      i += taken;
+      // Stop short on EOF
+      if (done) break;
     }
+    return i;
   }
 
   /**
-  * Reads until '\n' or EOF
+  * Reads raw bytes until EOF
   */
-  readLine() {
-    const result = []
-    while (true) {
-      const rd = Atomics.load(this.control, 0);
-      const wr = Atomics.load(this.control, 1);
+  readAllBytes() {
+    return this.#takeUntilDone(false);
+  }
 
-      // Buffer is empty if the read pointer equals the write pointer
-      if (rd === wr) {
-        // Buffer empty; wait on the write pointer
-        Atomics.wait(this.control, 1, wr);
-        continue;
-      }
+  /**
+  * Reads raw bytes until '\n' (kept) or EOF
+  */
+  readLineBytes() {
+    return this.#takeUntilDone(true);
+  }
 
-      const byte = this.data[rd];
+  /**
+  * Like `readInto`, but hands back the bytes in a new array. An empty array
+  * means EOF
+  */
+  readBytes(maxBytes) {
+    const parts = [];
+    this.#waitForData();
+    this.#take(maxBytes, this.#copyOut(parts));
+    return this.#concat(parts);
+  }
 
-      // Return on EOF without consuming 
-      if (byte == this.#EOF) return this.decoder.decode(new Uint8Array(result));
+  /**
+  * Blocks until it has read `exactBytes` of data
+  */
+  readExact(exactBytes) {
+    const bytes = new Uint8Array(exactBytes);
+    return this.decoder.decode(bytes.subarray(0, this.readExactInto(bytes, 0, exactBytes)));
+  }
 
-      // Consume
-      result.push(byte);
-      const newRd = (rd + 1) % this.data.length;
-      Atomics.store(this.control, 0, newRd);
-      Atomics.notify(this.control, 0, 1);
+  /**
+  * Blocks until at least 1 byte is available, and then
+  * tries to read up to `max_bytes` or EOF
+  */
+  read(maxBytes) {
+    return this.decoder.decode(this.readBytes(maxBytes));
+  }
 
-      // If byte was '\n' (10 in ASCII), break
-      if (byte === 10) {
-        break;
-      }
-    }
-    return this.decoder.decode(new Uint8Array(result));
+  /**
+  * Reads until EOF
+  */
+  readAll() {
+    return this.decoder.decode(this.readAllBytes());
+  }
+
+  /**
+  * Reads until '\n' or EOF
+  */
+  readLine() {
+    return this.decoder.decode(this.readLineBytes());
   }
 }
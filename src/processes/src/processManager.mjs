@@ -58,11 +58,14 @@ export default class ProcessManager {
    *
    * @param {string} [processScript="processes/src/process.js"] - The path to the worker script.
    * @param {string} [sourceCode=""] - The lua sourcode to be executed by the worker.
+   * @param {number} [pipeSize=0] - Capacity of the process' pipes, 0 for the table's default.
+   * @param {number} [pipeMax=0] - Capacity the pipes may grow to when the writer keeps blocking.
+   * @param {boolean} [heapPipe=false] - Place a piped stdout in the process' own WASM memory, so it's written from C. Such a pipe never grows.
    * @returns {number} - The newly allocated PID.
    *
    * @throws {Error} If the process table is full and cannot allocate another PID.
    */
-  async createProcess({ luaPath = "/persistent/bin/shell.lua", args = [], slave = undefined, pipeStdin = false, pipeStdout = false, redirectStdin = null, redirectStdout = null, callerSignal = null, start = false, cwd = "/persistent" }) {
+  async createProcess({ luaPath = "/persistent/bin/shell.lua", args = [], slave = undefined, pipeStdin = false, pipeStdout = false, redirectStdin = null, redirectStdout = null, callerSignal = null, start = false, cwd = "/persistent", pipeSize = 0, pipeMax = 0, heapPipe = false }) {
     if (!isNode && slave === undefined && (pipeStdin == false || pipeStdout == false)) {
       throw new CustomError(CustomError.symbols.PTY_PROCESS_NO_PTY);
     }
@@ -87,7 +90,7 @@ export default class ProcessManager {
 
     // Allocate space in the process table and retrieve references to the worker and channels
     let { pid } = await this.#processesTable.allocateProcess(
-      { args, slave, pipeStdin, pipeStdout, redirectStdin, redirectStdout, start, luaCode, cwd, fakePath }, // Defined behaviour for web-worker
+      { args, slave, pipeStdin, pipeStdout, redirectStdin, redirectStdout, start, luaCode, cwd, fakePath, pipeSize, pipeMax, heapPipe }, // Defined behaviour for web-worker
     );
 
     // Enqueue process to be initialised
@@ -236,14 +239,17 @@ export default class ProcessManager {
       throw new CustomError(CustomError.symbols.PIPE_STARTED_PROC);
     }
 
-    // Get the stdout buffer from the first process
+    // Get the stdout buffer from the first process, which may be its WASM
+    // memory with the pipe at an offset
     let outBuff = outProc.stdout.getBuffer();
+    let outOffset = outProc.stdout.offset;
     delete inProc.stdin;
 
     // Update our reference to the inProc's stdin
-    inProc.stdin = new Pipe(0, outBuff);
+    inProc.stdin = new Pipe(0, outBuff, 0, outOffset);
     // Update the stdin buffer we're sending to the process on start
     inProc.startMsg.stdin = outBuff;
+    inProc.startMsg.stdinOffset = outOffset;
   }
 
   /**
@@ -301,7 +307,7 @@ export default class ProcessManager {
         }
 
         try {
-          await this.createProcess({ luaPath: e.data.luaPath, args: e.data.args, slave: requestor.pty, pipeStdin, pipeStdout, redirectStdin: e.data.redirectStdin, redirectStdout: e.data.redirectStdout, callerSignal: sendBackSignal, cwd: e.data.cwd });
+          await this.createProcess({ luaPath: e.data.luaPath, args: e.data.args, slave: requestor.pty, pipeStdin, pipeStdout, redirectStdin: e.data.redirectStdin, redirectStdout: e.data.redirectStdout, callerSignal: sendBackSignal, cwd: e.data.cwd, pipeSize: e.data.pipeSize, pipeMax: e.data.pipeMax, heapPipe: e.data.heapPipe });
           // INFO: PID is written to callerSignal after a process is registered to it
         } catch (err) {
           if (!(err instanceof CustomError)) {
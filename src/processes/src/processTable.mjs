@@ -46,6 +46,9 @@ export default class ProcessTable {
    * @param {Object} processData - An object containing:
    *   - `processScript`: string path to the Worker script
    *   - `processFunction`: function to be stringified for the Worker
+   *   - `pipeSize`: optional capacity of the process' pipes, defaults to `this.pipeSize`
+   *   - `pipeMax`: optional capacity the pipes may adaptively grow to
+   *   - `heapPipe`: optionally place a piped stdout in the process' WASM memory
    * @returns {Object} An object with the structure:
    *   - `pid`: number - the allocated PID
    *   - `stdin`: MessagePort for input to the worker
@@ -70,9 +73,11 @@ export default class ProcessTable {
     // ============= Initialise Process Entry ============= 
 
     // Create MessageChannels for inter-process communication
-    const stdinPipe = new Pipe(this.pipeSize);
-    const stdoutPipe = new Pipe(this.pipeSize);
-    const stderrPipe = new Pipe(this.pipeSize);
+    const pipeSize = processData.pipeSize || this.pipeSize;
+    const pipeMax = Math.max(pipeSize, processData.pipeMax || 0);
+    const stdinPipe = new Pipe(pipeSize, null, pipeMax);
+    const stdoutPipe = new Pipe(pipeSize, null, pipeMax);
+    const stderrPipe = new Pipe(pipeSize, null, pipeMax);
     const signal = new Signal();
 
     const process = {
@@ -87,6 +92,9 @@ export default class ProcessTable {
       pty: processData.slave,
       pipeStdin: processData.pipeStdin,
       pipeStdout: processData.pipeStdout,
+      pipeSize: pipeSize,
+      heapPipe: processData.heapPipe,
+      stdoutRing: 0,
       redirectStdin: processData.redirectStdin,
       redirectStdout: processData.redirectStdout,
       cwd: processData.cwd,
@@ -125,6 +133,17 @@ export default class ProcessTable {
     })
 
     process.emscriptenBuffer = Module.wasmMemory.buffer;
+
+    // A piped stdout can live in the module's own memory, so the process
+    // writes to it from C. The reader maps that memory instead (see pipe.h).
+    // Builds that don't export the allocator keep the regular pipe
+    if (process.heapPipe && process.pipeStdout && typeof Module._pipe__new === "function") {
+      const ring = Module._pipe__new(process.pipeSize);
+      if (ring !== 0) {
+        process.stdout = new Pipe(0, process.emscriptenBuffer, 0, ring);
+        process.stdoutRing = ring;
+      }
+    }
   }
 
   registerWorker(pid, worker) {
@@ -143,6 +162,10 @@ export default class ProcessTable {
         stdin: registeredProcess.stdin.getBuffer(),
         stdout: registeredProcess.stdout.getBuffer(),
         stderr: registeredProcess.stderr.getBuffer(),
+        stdinOffset: registeredProcess.stdin.offset,
+        stdoutOffset: registeredProcess.stdout.offset,
+        stderrOffset: registeredProcess.stderr.offset,
+        stdoutRing: registeredProcess.stdoutRing,
         pipeStdin: registeredProcess.pipeStdin,
         pipeStdout: registeredProcess.pipeStdout,
         redirectStdin: registeredProcess.redirectStdin,
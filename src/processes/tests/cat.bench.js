@@ -0,0 +1,48 @@
+// `cat | cat | cat` throughput, run with `node tests/cat.bench.js`.
+// A producer writes through three cat stages (see catStage.js) into this
+// thread, once marshalling every stage through JS strings and once copying
+// bytes between the WASM heap and the pipes directly.
+import { Worker } from 'worker_threads';
+import Pipe from '../src/pipe.mjs';
+
+// The shell's default PIPE_SIZE and PIPE_MAX
+const PIPE_SIZE = 16 * 1024;
+const PIPE_MAX = 1024 * 1024;
+const TOTAL = 64 * 1024 * 1024;
+const STAGES = 3;
+
+function run(mode) {
+  return new Promise((resolve, reject) => {
+    const pipes = Array.from({ length: STAGES + 1 }, () => new Pipe(PIPE_SIZE, null, PIPE_MAX));
+    const workers = [];
+    for (let i = 0; i < STAGES; i++) {
+      workers.push(new Worker('./tests/catStage.js', {
+        workerData: { input: pipes[i].getBuffer(), output: pipes[i + 1].getBuffer(), mode }
+      }));
+    }
+    const producer = new Worker('./tests/writerBench.js', {
+      workerData: { buffer: pipes[0].getBuffer(), chunkSize: 4096, total: TOTAL }
+    });
+    workers.push(producer);
+    workers.forEach((w) => w.on('error', reject));
+
+    producer.once('message', () => {
+      const start = performance.now();
+      producer.postMessage('go');
+      const sink = new Uint8Array(64 * 1024);
+      let received = 0;
+      for (let n = pipes[STAGES].readInto(sink, 0, sink.length); n > 0; n = pipes[STAGES].readInto(sink, 0, sink.length)) {
+        received += n;
+      }
+      const seconds = (performance.now() - start) / 1000;
+      workers.forEach((w) => w.terminate());
+      if (received !== TOTAL) reject(new Error(`read ${received} of ${TOTAL} bytes`));
+      resolve(TOTAL / (1024 * 1024) / seconds);
+    });
+  });
+}
+
+for (const mode of ['strings', 'heap']) {
+  const mbs = await run(mode);
+  console.log(`${mode.padEnd(8)} ${mbs.toFixed(1).padStart(8)} MB/s`);
+}
@@ -0,0 +1,29 @@
+import { workerData, parentPort } from 'worker_threads';
+import Pipe from '../src/pipe.mjs';
+
+// One `cat` stage as the runtime runs it: input() into a buffer on the WASM
+// heap (shared memory, as the runtime is built with SHARED_MEMORY) and output()
+// from it. `strings` mode marshals through JS strings like stringToUTF8 and
+// UTF8ToString used to, `heap` mode copies straight to and from the pipes.
+const { input, output, mode } = workerData;
+const stdin = new Pipe(0, input);
+const stdout = new Pipe(0, output);
+const heap = new Uint8Array(new SharedArrayBuffer(8192)); // BUFSIZ, as process.input
+const encoder = new TextEncoder();
+const decoder = new TextDecoder();
+
+while (true) {
+  let n;
+  if (mode === 'strings') {
+    const s = stdin.read(heap.length);
+    n = encoder.encodeInto(s, heap).written;
+  } else {
+    n = stdin.readInto(heap, 0, heap.length);
+  }
+  if (n === 0) break;
+
+  if (mode === 'strings') stdout.write(decoder.decode(heap.slice(0, n)));
+  else stdout.writeBytes(heap.subarray(0, n));
+}
+stdout.close();
+parentPort.postMessage('done');
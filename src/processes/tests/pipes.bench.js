@@ -0,0 +1,50 @@
+// Pipe throughput benchmark, run with `node tests/pipes.bench.js`.
+// A worker writes a fixed volume in 1 B, 4 KiB and 1 MiB writes while this
+// thread drains the pipe with read(). Reports MB/s and how many times the two
+// ends put each other to sleep per MiB, for fixed and adaptive pipes.
+import { Worker } from 'worker_threads';
+import Pipe from '../src/pipe.mjs';
+
+const pipes = [
+  { label: '1 KiB', size: 1024, maxSize: 1024 },
+  { label: '64 KiB', size: 64 * 1024, maxSize: 64 * 1024 },
+  { label: '1 KiB..1 MiB', size: 1024, maxSize: 1024 * 1024 },
+];
+const writes = [
+  { label: '1 B', chunkSize: 1, total: 256 * 1024 },
+  { label: '4 KiB', chunkSize: 4 * 1024, total: 64 * 1024 * 1024 },
+  { label: '1 MiB', chunkSize: 1024 * 1024, total: 64 * 1024 * 1024 },
+];
+
+function run({ size, maxSize }, { chunkSize, total }) {
+  return new Promise((resolve, reject) => {
+    const pipe = new Pipe(size, null, maxSize);
+    const writer = new Worker('./tests/writerBench.js', {
+      workerData: { buffer: pipe.getBuffer(), chunkSize, total }
+    });
+    writer.on('error', reject);
+    writer.once('message', () => {
+      const start = performance.now();
+      writer.postMessage('go');
+      let received = 0;
+      for (let s = pipe.read(64 * 1024); s.length > 0; s = pipe.read(64 * 1024)) {
+        received += s.length;
+      }
+      const seconds = (performance.now() - start) / 1000;
+      if (received !== total) reject(new Error(`read ${received} of ${total} bytes`));
+      writer.once('message', (writerWakeups) => {
+        writer.terminate();
+        const mib = total / (1024 * 1024);
+        resolve({ mbs: mib / seconds, wakeups: (pipe.wakeups + writerWakeups) / mib });
+      });
+    });
+  });
+}
+
+console.log(`${'pipe'.padEnd(14)}${'write'.padStart(6)}${'MB/s'.padStart(10)}${'wake-ups/MiB'.padStart(14)}`);
+for (const p of pipes) {
+  for (const w of writes) {
+    const { mbs, wakeups } = await run(p, w);
+    console.log(`${p.label.padEnd(14)}${w.label.padStart(6)}${mbs.toFixed(1).padStart(10)}${wakeups.toFixed(1).padStart(14)}`);
+  }
+}
@@ -416,6 +416,77 @@ describe('Pipe Tests', function() {
     });
   });
 
+  it('readBytes should pass every byte value through, 0xFF included', (done) => {
+    const pipe = new Pipe(10);
+    const bytes = Uint8Array.from({ length: 1024 }, (_, i) => 255 - (i % 256));
+    const pipeBuffer = pipe.getBuffer();
+
+    const writer = new Worker('./tests/writerBytesEOF.js', {
+      workerData: { buffer: pipeBuffer, bytes }
+    });
+
+    const reader = new Worker('./tests/readBytesReader.js', {
+      workerData: { buffer: pipeBuffer, maxBytes: 7 }
+    });
+
+    reader.on('message', (msg) => {
+      expect(Array.from(msg)).to.deep.equal(Array.from(bytes));
+      done();
+    });
+    reader.on('error', done);
+    writer.on('error', done);
+  });
+
+  it('adaptive pipe should grow when the writer keeps blocking', (done) => {
+    const pipe = new Pipe(8, null, 4096);
+    const message = Array.from({ length: 20000 }, (_, i) => i % 10).join('');
+    const pipeBuffer = pipe.getBuffer();
+
+    const writer = new Worker('./tests/writerEOF.js', {
+      workerData: { buffer: pipeBuffer, message }
+    });
+
+    const reader = new Worker('./tests/readAllReader.js', {
+      workerData: { buffer: pipeBuffer }
+    });
+
+    reader.on('message', (msg) => {
+      expect(msg).to.equal(message);
+      expect(new Pipe(0, pipeBuffer).data.length).to.be.above(8);
+      done();
+    });
+    reader.on('error', done);
+    writer.on('error', done);
+  });
+
+  it('should work at an offset inside a larger buffer', (done) => {
+    // Laid out like a pipe.h Pipe somewhere in a process' WASM memory
+    const offset = 256;
+    const capacity = 9;
+    const memory = new SharedArrayBuffer(1024);
+    new Int32Array(memory, offset, 3)[2] = capacity;
+    const message = 'Message spanning the ring a few times';
+
+    const writer = new Worker('./tests/writerEOF.js', {
+      workerData: { buffer: memory, message, offset }
+    });
+
+    const reader = new Worker('./tests/readAllReader.js', {
+      workerData: { buffer: memory, offset }
+    });
+
+    reader.on('message', (msg) => {
+      expect(msg).to.equal(message);
+      // Nothing outside the pipe was touched
+      const bytes = new Uint8Array(memory);
+      expect(bytes.subarray(0, offset).every((b) => b === 0)).to.equal(true);
+      expect(bytes.subarray(offset + 12 + capacity).every((b) => b === 0)).to.equal(true);
+      done();
+    });
+    reader.on('error', done);
+    writer.on('error', done);
+  });
+
   it('isClosed should reflect whether pipe is closed or not', () => {
     const pipe = new Pipe(2);
     pipe.close();
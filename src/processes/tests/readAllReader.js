@@ -1,8 +1,8 @@
 import { workerData, parentPort } from 'worker_threads';
 import Pipe from '../src/pipe.mjs';
 
-const { buffer } = workerData;
-const pipe = new Pipe(0, buffer);
+const { buffer, offset } = workerData;
+const pipe = new Pipe(0, buffer, 0, offset);
 
 const result = pipe.readAll();
 parentPort.postMessage(result);
@@ -0,0 +1,13 @@
+import { workerData, parentPort } from 'worker_threads';
+import Pipe from '../src/pipe.mjs';
+
+const { buffer, maxBytes } = workerData;
+const pipe = new Pipe(0, buffer);
+
+// Read until EOF, which readBytes signals with an empty result
+const result = [];
+for (let bytes = pipe.readBytes(maxBytes); bytes.length > 0; bytes = pipe.readBytes(maxBytes)) {
+  result.push(...bytes);
+}
+parentPort.postMessage(Uint8Array.from(result));
+process.exit(0);
@@ -0,0 +1,15 @@
+import { workerData, parentPort } from 'worker_threads';
+import Pipe from '../src/pipe.mjs';
+
+const { buffer, chunkSize, total } = workerData;
+const pipe = new Pipe(0, buffer);
+const chunk = 'x'.repeat(chunkSize);
+
+// Wait for the reader before starting the clock
+parentPort.postMessage('ready');
+parentPort.once('message', () => {
+  for (let sent = 0; sent < total; sent += chunkSize) pipe.write(chunk);
+  pipe.close();
+  // Report how often the writer slept on a full pipe
+  parentPort.postMessage(pipe.wakeups);
+});
@@ -0,0 +1,9 @@
+import { workerData } from 'worker_threads';
+import Pipe from '../src/pipe.mjs';
+
+const { buffer, bytes } = workerData;
+const pipe = new Pipe(0, buffer);
+
+pipe.writeBytes(bytes);
+pipe.close();
+process.exit(0);
@@ -1,8 +1,8 @@
 import { workerData } from 'worker_threads';
 import Pipe from '../src/pipe.mjs';
 
-const { buffer, message } = workerData;
-const pipe = new Pipe(0, buffer);
+const { buffer, message, offset } = workerData;
+const pipe = new Pipe(0, buffer, 0, offset);
 
 pipe.write(message);
 pipe.close();
@@ -24,6 +24,13 @@ DIRECTORY --[[@type number]] = nil
 ---@field mtime Time Last modified.
 ---@field ctime Time Last time properties were changed.
 
+---@class File_Cache_Stats
+---@field hits number Stats answered from the cache.
+---@field misses number Stats that had to look at the filesystem.
+---@field invalidations number Changes that emptied the cache.
+---@field entries number Stats the cache currently holds.
+---@field capacity number The most stats the cache can hold.
+
 ---Create or open a file.
 ---@param path string The path to the file.
 ---@param flags string A string containing sequence of "r" (read), "w" (write) and "c" (create).
@@ -38,12 +45,13 @@ function file.open(path, flags) end
 ---@diagnostic disable-next-line: unused-local
 function file.close(fd) end
 
----Write some text to a file.
+---Write some text to a file. Any further strings are written straight after it in a single write.
 ---@param fd number The file descriptor associated with the file to write to.
----@param text string The text to write.
+---@param text string The text to write, may contain any bytes.
+---@param ... string More text to write after it.
 ---@return number | nil err Error code.
 ---@diagnostic disable-next-line: unused-local
-function file.write(fd, text) end
+function file.write(fd, text, ...) end
 
 ---Read some text from a file.
 ---@param fd number The file descriptor associated with the file to read from.
@@ -53,6 +61,38 @@ function file.write(fd, text) end
 ---@diagnostic disable-next-line: unused-local
 function file.read(fd, amt) end
 
+---Read some text from a position in a file, without moving its cursor.
+---@param fd number The file descriptor associated with the file to read from.
+---@param offset number The position to read from, 0 being the start of the file.
+---@param amt number The number of bytes to read, fewer are returned only at the end of the file.
+---@return string | nil text The text that was read.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.read_at(fd, offset, amt) end
+
+---Write some text at a position in a file, without moving its cursor.
+---@param fd number The file descriptor associated with the file to write to.
+---@param offset number The position to write at, 0 being the start of the file.
+---@param text string The text to write, may contain any bytes.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.write_at(fd, offset, text) end
+
+---Set aside room for a file to grow to, so writing it up to that size doesn't keep growing it piece by piece. The
+---file's size is unchanged, only a hint.
+---@param fd number The file descriptor associated with the file that will be written.
+---@param size number The size in bytes the file is expected to reach.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.reserve(fd, size) end
+
+---Cut or extend a file to a size, releasing any room reserved past it.
+---@param fd number The file descriptor associated with the file to resize.
+---@param length number The new size in bytes.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.truncate(fd, length) end
+
 ---Read all the text from a file.
 ---@param fd number The file descriptor associated with the file to read from.
 ---@return string | nil text The text contents of the file.
@@ -60,6 +100,61 @@ function file.read(fd, amt) end
 ---@diagnostic disable-next-line: unused-local
 function file.read_all(fd) end
 
+---Read the next line from a file, without its trailing newline.
+---@param fd number The file descriptor associated with the file to read from.
+---@return string | nil line The line that was read, nil once the end of the file is reached.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.read_line(fd) end
+
+---@class File_Map
+---A read-only view of a whole file, searched in place rather than read into a string. `#map` gives its size.
+local File_Map = {}
+
+---Copy part of the file out, as string.sub.
+---@param i number The first byte (negative counts from the end).
+---@param j? number The last byte (defaults to -1).
+---@return string slice The bytes from i to j.
+---@diagnostic disable-next-line: unused-local
+function File_Map:sub(i, j) end
+
+---Search the file, as string.find.
+---@param pattern string The Lua pattern to look for.
+---@param init? number Where to start searching (defaults to 1).
+---@param plain? boolean Treat the pattern as plain text.
+---@return number | nil start Where the match starts.
+---@return number | nil finish Where the match ends, followed by any captures.
+---@diagnostic disable-next-line: unused-local
+function File_Map:find(pattern, init, plain) end
+
+---Iterate over the file's lines, without their newlines.
+---@return fun(): string | nil iterator Yields each line.
+function File_Map:lines() end
+
+---Release the mapping, also done when the map is collected or goes out of scope.
+function File_Map:close() end
+
+---Map a file into memory to scan it without reading it into a string.
+---@param path string The path of the file to map.
+---@return File_Map | nil map The mapped file.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.map(path) end
+
+---Count the lines in a string or mapped file, as File_Map:lines() would yield them.
+---@param subject string | File_Map The text to count lines in.
+---@return number count The number of lines.
+---@diagnostic disable-next-line: unused-local
+function file.count_lines(subject) end
+
+---Find the first byte that is any of the given bytes, like `subject:find("[" .. bytes .. "]", init)` without the pattern.
+---@param subject string | File_Map The text to search.
+---@param bytes string The bytes to look for.
+---@param init? number Where to start searching (defaults to 1).
+---@return number | nil index The position of the byte found.
+---@diagnostic disable-next-line: unused-local
+function file.index_of(subject, bytes, init) end
+
 ---Move the cursor for open file forward.
 ---@param fd number The file descriptor associated with the open file.
 ---@param amount number The number of characters to shift by.
@@ -80,6 +175,14 @@ function file.jump(fd, position) end
 ---@diagnostic disable-next-line: unused-local
 function file.remove(path) end
 
+---Replace a file's contents all at once, creating it if needed. The new contents are written beside it and then
+---renamed into place, so the file is never left half written.
+---@param path string The path of the file to replace.
+---@param text string The new contents, may contain any bytes.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.replace_contents(path, text) end
+
 ---Move file or directory from one path to another (rename).
 ---@param old_path string The old path of the file.
 ---@param new_path string The new path of the file.
@@ -87,6 +190,20 @@ function file.remove(path) end
 ---@diagnostic disable-next-line: unused-local
 function file.move(old_path, new_path) end
 
+---Copy a file, streaming its contents rather than reading them into Lua.
+---@param src_path string The path of the file to copy.
+---@param dst_path string The path to copy it to, created or overwritten.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.copy(src_path, dst_path) end
+
+---Copy a file, or a directory and everything beneath it (akin to `cp -r'). Existing directories are merged into.
+---@param src_path string The path of the file or directory to copy.
+---@param dst_path string The path to copy it to.
+---@return number | nil err Error code, from the first node that failed. The other nodes are still copied.
+---@diagnostic disable-next-line: unused-local
+function file.copy_tree(src_path, dst_path) end
+
 ---Make a directory.
 ---@param path string The path of the new directory.
 ---@return number | nil err Error code.
@@ -99,18 +216,48 @@ function file.make_dir(path) end
 ---@diagnostic disable-next-line: unused-local
 function file.remove_dir(path) end
 
+---Remove a file, or a directory and everything beneath it (akin to `rm -r').
+---@param path string The path of the file or directory to remove.
+---@return number | nil err Error code, from the first node that failed. The other nodes are still removed.
+---@diagnostic disable-next-line: unused-local
+function file.remove_tree(path) end
+
 ---Change the current working directory.
 ---@param path string The path to the new working directory.
 ---@return number | nil err Error code.
 ---@diagnostic disable-next-line: unused-local
 function file.change_dir(path) end
 
+---@class Read_Dir_Opts
+---@field stat? boolean Return each entry's metadata alongside its name.
+
+---@class Dir_Entry
+---@field name string The entry's name.
+---@field stat? File_Status The entry's metadata, nil if it couldn't be read (e.g. the entry was removed meanwhile).
+
 ---Read the contents of a directory (akin to `ls').
 ---@param path string The path of directory to read from.
----@return string[] | nil entries The directory contents.
+---@param opts? Read_Dir_Opts Read options (optional).
+---@return string[] | Dir_Entry[] | nil entries The directory contents, as Dir_Entry when `opts.stat` is set.
 ---@return number | nil err Error code.
 ---@diagnostic disable-next-line: unused-local
-function file.read_dir(path) end
+function file.read_dir(path, opts) end
+
+---@class Walk_Opts
+---@field max_depth? number The deepest level to report, the root being 0 (unlimited by default).
+---@field type? number Only report FILE or DIRECTORY nodes (both by default).
+---@field prune? fun(path: string, stat: File_Status, depth: number): boolean Return true to skip everything beneath a directory.
+
+---Walk the tree under a directory depth first, the directory itself first and then each entry before its children.
+---Use in a generic for: `for path, stat, depth, err in file.walk(path) do ... end`, breaking out early releases the walk.
+---Symlinks below `path` are reported with their target's metadata but never entered. A node that can't be read is yielded with `err`
+---set (and `stat` nil if it couldn't be stat'ed, e.g. it was removed meanwhile), and the walk carries on.
+---@param path string The path of the directory to walk.
+---@param opts? Walk_Opts Walk options (optional).
+---@return (fun(): string, File_Status | nil, number, number | nil) | nil iterator Yields each node's path, metadata, depth and error.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function file.walk(path, opts) end
 
 ---Get file or directory metadata.
 ---@param path string The path of the file or directory with the to be returned metadata.
@@ -126,6 +273,11 @@ function file.stat(path) end
 ---@diagnostic disable-next-line: unused-local
 function file.fdstat(fd) end
 
+---Get the counters of the cache file.stat and file.read_dir (with stat) fill. Changes made by this process empty it,
+---changes made by others can take a second to show.
+---@return File_Cache_Stats stats The counters.
+function file.cache_stats() end
+
 ---Change the permissions of an open file.
 ---@param path string The path of the file or directory with the to be returned metadata.
 ---@param flags string A string containing sequence of "r" (read), "w" (write) and "x" (executable).
@@ -152,6 +304,9 @@ STDOUT --[[@type number]] = nil
 ---@field pipe_in? boolean Whether to pipe standard input.
 ---@field pipe_out? boolean Whether to pipe standard output.
 ---@field argv? string[] The command line arguments passed to the created process.
+---@field pipe_size? integer Capacity in bytes of the process' pipes, at least 2 (default 1024, at most 64 MiB).
+---@field pipe_max? integer Not less than `pipe_size`. If larger, the pipes double in size up to this many bytes when the writer keeps blocking on a full pipe.
+---@field heap_pipe? boolean Keep a piped standard output in the process' own memory, so writes don't go through JS. It stays at `pipe_size` and never grows.
 -- @field redirect_in? string Redirect input from this file.
 -- @field redirect_out? string Redirect output to this file, if it doesn't exist it creates it.
 
@@ -196,6 +351,13 @@ function process.exit(code) os.exit(code) end
 ---@return number | nil err Error code.
 function process.input() end
 
+---Read raw bytes from standard input, any byte value (zero included) is kept.
+---@param max_bytes? integer The most bytes to read (optional).
+---@return string | nil bytes The bytes read, "" at the end of input.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function process.input_bytes(max_bytes) end
+
 ---Read all text from standard input.
 ---@return string | nil text The rest of standard input after called.
 ---@return number | nil err Error code.
@@ -217,6 +379,20 @@ function process.close_input() end
 ---@diagnostic disable-next-line: unused-local
 function process.output(text, opts) end
 
+---Output raw bytes to standard output, exactly as given: no newline is added.
+---@param bytes string The bytes to output.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function process.output_bytes(bytes) end
+
+---Set how output is buffered when it is redirected to a file, mirroring C's setvbuf.
+---Buffered output is flushed when the buffer fills, on process.close_output and on exit.
+---@param mode "full" | "line" | "none" Flush when full, also every complete line, or write straight through.
+---@param size? number The buffer size in bytes (optional).
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function process.output_buffering(mode, size) end
+
 ---Wait for process to exit.
 ---@param pid number The identifier of the process to wait for.
 ---@return number | nil err Er_Descriptorror code.
@@ -276,6 +452,54 @@ function errors.as_string(code) end
 ---@diagnostic disable-next-line: unused-local
 function errors.ok(code, msg) end
 
+---Native searching of whole files.
+search = {}
+
+---@class Search_Opts
+---@field plain? boolean Treat every pattern as plain text.
+---@field ignore_case? boolean Match regardless of case.
+---@field invert? boolean Report the lines that don't match instead, each spanning the whole line.
+---@field max_count? number Stop after this many lines (unlimited by default).
+---@field batch? number The most lines handed back at once (256 by default).
+
+---@class Search_Scan
+---A search through a file, handing back the lines that match in batches.
+local Search_Scan = {}
+
+---Get the next batch of matches. Each takes three slots: the line number, then the first and last byte of the match.
+---@return number[] | nil batch The matches, nil once there are none left.
+function Search_Scan:next() end
+
+---Iterate over the batches: `for batch in scan:batches() do ... end`.
+---@return fun(): number[] | nil iterator Yields each batch.
+function Search_Scan:batches() end
+
+---Get the line holding a byte, without its newline.
+---@param i number The byte, such as the first byte of a match.
+---@return string line The line.
+---@diagnostic disable-next-line: unused-local
+function Search_Scan:line(i) end
+
+---Copy part of the file out, as string.sub.
+---@param i number The first byte (negative counts from the end).
+---@param j? number The last byte (defaults to -1).
+---@return string slice The bytes from i to j.
+---@diagnostic disable-next-line: unused-local
+function Search_Scan:sub(i, j) end
+
+---Release the file, also done when the scan is collected or goes out of scope.
+function Search_Scan:close() end
+
+---Search a file for the lines matching any of the patterns (akin to `grep'), reporting the first match on each line.
+---When more than one pattern matches a line, the one given first is reported.
+---@param target number | string The file descriptor or path of the file to search, always searched from its start.
+---@param pattern string | string[] The Lua pattern(s) to look for, matched against one line at a time.
+---@param opts? Search_Opts Search options (optional).
+---@return Search_Scan | nil scan The search.
+---@return number | nil err Error code.
+---@diagnostic disable-next-line: unused-local
+function search.scan(target, pattern, opts) end
+
 ---Terminal specific functions.
 terminal = {}
 
@@ -23,9 +23,12 @@ async function initWorkerForProcess(data) {
     pid: data.pid,
     cwd: data.cwd,
     args: data.args,
-    stdin: new Pipe(0, data.stdin),
-    stdout: new Pipe(0, data.stdout),
-    stderr: new Pipe(0, data.stderr),
+    stdin: new Pipe(0, data.stdin, 0, data.stdinOffset),
+    stdout: new Pipe(0, data.stdout, 0, data.stdoutOffset),
+    stderr: new Pipe(0, data.stderr, 0, data.stderrOffset),
+    // Address of stdout's ring when it lives in our own memory, written to
+    // straight from C (see pipe.h), otherwise 0
+    stdoutRing: data.stdoutRing ?? 0,
     redirectStdin: data.redirectStdin,
     redirectStdout: data.redirectStdout,
     isInATTY: false,
@@ -34,41 +37,43 @@ async function initWorkerForProcess(data) {
     StreamDescriptor,
     luaCode: data.luaCode,
     signal: new Signal(data.signal),
+    // Input and output move raw bytes between a pipe and `target`/`bytes`,
+    // which are views of the WASM heap, so nothing passes through JS strings
     // DOESNT RETURN AN ERRORCODE
-    input: (maxBytes) => {
+    input: (target, offset, maxBytes) => {
       changeState(ProcessStates.SLEEPING);
-      let s = self.proc.stdin.read(maxBytes);
+      let n = self.proc.stdin.readInto(target, offset, maxBytes);
       changeState(ProcessStates.RUNNING);
-      return s;
+      return n;
     },
     // DOESNT RETURN AN ERRORCODE
     inputLine: () => {
       changeState(ProcessStates.SLEEPING);
-      let s = self.proc.stdin.readLine();
+      let bytes = self.proc.stdin.readLineBytes();
       changeState(ProcessStates.RUNNING);
-      return s;
+      return bytes;
     },
     // DOESNT RETURN AN ERRORCODE
     inputAll: () => {
       changeState(ProcessStates.SLEEPING);
-      let s = self.proc.stdin.readAll();
+      let bytes = self.proc.stdin.readAllBytes();
       changeState(ProcessStates.RUNNING);
-      return s;
+      return bytes;
     },
     // DOESNT RETURN AN ERRORCODE
-    inputExact: (exactBytes) => {
+    inputExact: (target, offset, exactBytes) => {
       changeState(ProcessStates.SLEEPING);
-      let s = self.proc.stdin.readExact(exactBytes);
+      let n = self.proc.stdin.readExactInto(target, offset, exactBytes);
       changeState(ProcessStates.RUNNING);
-      return s;
+      return n;
     },
     // DOESNT RETURN AN ERRORCODE
-    output: (msg) => {
-      self.proc.stdout.write(msg);
+    output: (bytes) => {
+      self.proc.stdout.writeBytes(bytes);
     },
     // DOESNT RETURN AN ERRORCODE
-    error: (msg) => {
-      self.proc.stderr.write(msg);
+    error: (bytes) => {
+      self.proc.stderr.writeBytes(bytes);
     },
     // DOESNT RETURN AN ERRORCODE
     wait: (pid) => {
@@ -85,7 +90,7 @@ async function initWorkerForProcess(data) {
       changeState(ProcessStates.RUNNING);
       return exitCode;
     },
-    create: (luaPath, args = [], pipeStdin = false, pipeStdout = false, redirectStdin = null, redirectStdout = null, cwd = "/persistent") => {
+    create: (luaPath, args = [], pipeStdin = false, pipeStdout = false, redirectStdin = null, redirectStdout = null, cwd = "/persistent", pipeSize = 0, pipeMax = 0, heapPipe = false) => {
       // Tell the manager we'd like to create a process
       self.postMessage({
         op: ProcessOperations.CREATE_PROCESS,
@@ -97,7 +102,10 @@ async function initWorkerForProcess(data) {
         pipeStdout,
         redirectStdin,
         redirectStdout,
-        cwd
+        cwd,
+        pipeSize,
+        pipeMax,
+        heapPipe
       });
       changeState(ProcessStates.SLEEPING);
       self.proc.signal.sleep();
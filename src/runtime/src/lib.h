@@ -6,6 +6,7 @@
 #include "process.h"
 #include "errors.h"
 #include "terminal.h"
+#include "search.h"
 #include "lauxlib.h"
 #ifdef __EMSCRIPTEN__
 #include "window.h"
@@ -27,19 +28,32 @@ static const luaL_Reg file_module[] = {
   {"close", lfile__close},
   {"write", lfile__write},
   {"read", lfile__read},
+  {"read_at", lfile__read_at},
+  {"write_at", lfile__write_at},
   {"read_all", lfile__read_all},
+  {"read_line", lfile__read_line},
+  {"map", lfile__map},
+  {"count_lines", lfile__count_lines},
+  {"index_of", lfile__index_of},
   {"shift", lfile__shift},
   {"jump", lfile__goto},
   {"remove", lfile__remove},
+  {"replace_contents", lfile__replace_contents},
   {"move", lfile__move},
+  {"copy", lfile__copy},
+  {"copy_tree", lfile__copy_tree},
   {"make_dir", lfile__make_dir},
   {"remove_dir", lfile__remove_dir},
+  {"remove_tree", lfile__remove_tree},
   {"change_dir", lfile__change_dir},
   {"read_dir", lfile__read_dir},
+  {"walk", lfile__walk},
   {"stat", lfile__stat},
   {"fdstat", lfile__fdstat},
+  {"cache_stats", lfile__cache_stats},
   {"permit", lfile__permit},
   {"truncate", lfile__truncate},
+  {"reserve", lfile__reserve},
   {"cwd", lfile__cwd},
   {NULL, NULL},
 };
@@ -50,6 +64,7 @@ static const luaL_Reg process_module[] = {
   {"start", lprocess__start},
   {"wait", lprocess__wait},
   {"output", lprocess__output},
+  {"output_bytes", lprocess__output_bytes},
   {"kill", lprocess__kill},
   {"get_pid", lprocess__get_pid},
   {"list", lprocess__list},
@@ -57,10 +72,12 @@ static const luaL_Reg process_module[] = {
   {"isatty", lprocess__isatty},
   {"exit", lprocess__exit},
   {"input", lprocess__input},
+  {"input_bytes", lprocess__input_bytes},
   {"input_all", lprocess__input_all},
   {"input_line", lprocess__input_line},
   {"close_input", lprocess__close_input},
   {"close_output", lprocess__close_output},
+  {"output_buffering", lprocess__output_buffering},
   {NULL, NULL},
 };
 
@@ -71,6 +88,12 @@ static const luaL_Reg errors_module[] = {
   {NULL, NULL},
 };
 
+#define SEARCH_MODULE_NAME "search"
+static const luaL_Reg search_module[] = {
+  {"scan", lsearch__scan},
+  {NULL, NULL},
+};
+
 #define TERMINAL_MODULE_NAME "terminal"
 static const luaL_Reg terminal_module[] = {
   {"clear", lterminal__clear},
@@ -104,6 +127,7 @@ static const Named_Module custom_modules[] = {
   {FILE_MODULE_NAME, file_module},
   {PROCESS_MODULE_NAME, process_module},
   {ERRORS_MODULE_NAME, errors_module},
+  {SEARCH_MODULE_NAME, search_module},
   {TERMINAL_MODULE_NAME, terminal_module},
   {WINDOW_MODULE_NAME, window_module},
   {NULL, NULL}
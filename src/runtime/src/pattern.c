@@ -0,0 +1,364 @@
+#include "pattern.h"
+#include "lauxlib.h"
+#include "../../filesystem/src/scan.h"
+#include <ctype.h>
+#include <string.h>
+
+// Adapted from lua 5.4's lstrlib.c (MIT), where the matcher is static. The
+// subject here may be a view with no NUL after it, so it's never read at or
+// past `src_end`
+
+#define L_ESC '%'
+#define SPECIALS "^$*+?.([%-"
+#define MAXCCALLS 200
+#define CAP_UNFINISHED (-1)
+#define CAP_POSITION (-2)
+
+#define uchar(c) ((unsigned char)(c))
+
+static const char *match(PatternState *ms, const char *s, const char *p);
+
+static int check_capture(PatternState *ms, int l) {
+  l -= '1';
+  if (l < 0 || l >= ms->level || ms->capture[l].len == CAP_UNFINISHED)
+    return luaL_error(ms->L, "invalid capture index %%%d", l + 1);
+  return l;
+}
+
+static int capture_to_close(PatternState *ms) {
+  int level = ms->level;
+  for (level--; level >= 0; level--)
+    if (ms->capture[level].len == CAP_UNFINISHED) return level;
+  return luaL_error(ms->L, "invalid pattern capture");
+}
+
+static const char *class_end(PatternState *ms, const char *p) {
+  switch (*p++) {
+  case L_ESC:
+    if (p == ms->p_end) luaL_error(ms->L, "malformed pattern (ends with '%%')");
+    return p + 1;
+  case '[':
+    if (*p == '^') p++;
+    do { // look for a ']'
+      if (p == ms->p_end) luaL_error(ms->L, "malformed pattern (missing ']')");
+      if (*(p++) == L_ESC && p < ms->p_end) p++; // skip escapes (e.g. '%]')
+    } while (*p != ']');
+    return p + 1;
+  default:
+    return p;
+  }
+}
+
+static int match_class(int c, int cl) {
+  int res;
+  switch (tolower(cl)) {
+  case 'a': res = isalpha(c); break;
+  case 'c': res = iscntrl(c); break;
+  case 'd': res = isdigit(c); break;
+  case 'g': res = isgraph(c); break;
+  case 'l': res = islower(c); break;
+  case 'p': res = ispunct(c); break;
+  case 's': res = isspace(c); break;
+  case 'u': res = isupper(c); break;
+  case 'w': res = isalnum(c); break;
+  case 'x': res = isxdigit(c); break;
+  default: return cl == c;
+  }
+  if (isupper(cl)) res = !res;
+  return res;
+}
+
+static int match_bracket_class(int c, const char *p, const char *ec) {
+  int sig = 1;
+  if (*(p + 1) == '^') {
+    sig = 0;
+    p++; // skip the '^'
+  }
+  while (++p < ec) {
+    if (*p == L_ESC) {
+      p++;
+      if (match_class(c, uchar(*p))) return sig;
+    } else if (*(p + 1) == '-' && (p + 2 < ec)) {
+      p += 2;
+      if (uchar(*(p - 2)) <= c && c <= uchar(*p)) return sig;
+    } else if (uchar(*p) == c) {
+      return sig;
+    }
+  }
+  return !sig;
+}
+
+static int single_match(PatternState *ms, const char *s, const char *p, const char *ep) {
+  if (s >= ms->src_end) return 0;
+  int c = uchar(*s);
+  switch (*p) {
+  case '.': return 1;
+  case L_ESC: return match_class(c, uchar(*(p + 1)));
+  case '[': return match_bracket_class(c, p, ep - 1);
+  default: return uchar(*p) == c;
+  }
+}
+
+static const char *match_balance(PatternState *ms, const char *s, const char *p) {
+  if (p >= ms->p_end - 1) luaL_error(ms->L, "malformed pattern (missing arguments to '%%b')");
+  if (s >= ms->src_end || *s != *p) return NULL;
+
+  int b = *p;
+  int e = *(p + 1);
+  int cont = 1;
+  while (++s < ms->src_end) {
+    if (*s == e) {
+      if (--cont == 0) return s + 1;
+    } else if (*s == b) {
+      cont++;
+    }
+  }
+  return NULL;
+}
+
+static const char *max_expand(PatternState *ms, const char *s, const char *p, const char *ep) {
+  ptrdiff_t i = 0;
+  while (single_match(ms, s + i, p, ep)) i++;
+  // Try with the most repetitions, backing off one at a time
+  while (i >= 0) {
+    const char *res = match(ms, s + i, ep + 1);
+    if (res) return res;
+    i--;
+  }
+  return NULL;
+}
+
+static const char *min_expand(PatternState *ms, const char *s, const char *p, const char *ep) {
+  for (;;) {
+    const char *res = match(ms, s, ep + 1);
+    if (res != NULL) return res;
+    if (!single_match(ms, s, p, ep)) return NULL;
+    s++;
+  }
+}
+
+static const char *start_capture(PatternState *ms, const char *s, const char *p, int what) {
+  int level = ms->level;
+  if (level >= PATTERN_MAXCAPTURES) luaL_error(ms->L, "too many captures");
+  ms->capture[level].init = s;
+  ms->capture[level].len = what;
+  ms->level = level + 1;
+  const char *res = match(ms, s, p);
+  if (res == NULL) ms->level--; // undo capture
+  return res;
+}
+
+static const char *end_capture(PatternState *ms, const char *s, const char *p) {
+  int l = capture_to_close(ms);
+  ms->capture[l].len = s - ms->capture[l].init;
+  const char *res = match(ms, s, p);
+  if (res == NULL) ms->capture[l].len = CAP_UNFINISHED; // undo capture
+  return res;
+}
+
+static const char *match_capture(PatternState *ms, const char *s, int l) {
+  l = check_capture(ms, l);
+  size_t len = ms->capture[l].len;
+  if ((size_t)(ms->src_end - s) >= len && memcmp(ms->capture[l].init, s, len) == 0) return s + len;
+  return NULL;
+}
+
+static const char *match(PatternState *ms, const char *s, const char *p) {
+  if (ms->matchdepth-- == 0) luaL_error(ms->L, "pattern too complex");
+init: // using goto to optimise tail recursion
+  if (p != ms->p_end) {
+    switch (*p) {
+    case '(':
+      if (*(p + 1) == ')') s = start_capture(ms, s, p + 2, CAP_POSITION);
+      else s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
+      break;
+    case ')':
+      s = end_capture(ms, s, p + 1);
+      break;
+    case '$':
+      if ((p + 1) != ms->p_end) goto dflt; // not the end of the pattern
+      s = (s == ms->src_end) ? s : NULL;
+      break;
+    case L_ESC:
+      switch (*(p + 1)) {
+      case 'b':
+        s = match_balance(ms, s, p + 2);
+        if (s != NULL) {
+          p += 4;
+          goto init;
+        }
+        break;
+      case 'f': {
+        p += 2;
+        if (*p != '[') luaL_error(ms->L, "missing '[' after '%%f' in pattern");
+        const char *ep = class_end(ms, p);
+        char previous = (s == ms->src_init) ? '\0' : *(s - 1);
+        char current = (s < ms->src_end) ? *s : '\0';
+        if (!match_bracket_class(uchar(previous), p, ep - 1) && match_bracket_class(uchar(current), p, ep - 1)) {
+          p = ep;
+          goto init;
+        }
+        s = NULL;
+        break;
+      }
+      case '0': case '1': case '2': case '3': case '4':
+      case '5': case '6': case '7': case '8': case '9':
+        s = match_capture(ms, s, uchar(*(p + 1)));
+        if (s != NULL) {
+          p += 2;
+          goto init;
+        }
+        break;
+      default:
+        goto dflt;
+      }
+      break;
+    default:
+    dflt: {
+      const char *ep = class_end(ms, p);
+      if (!single_match(ms, s, p, ep)) {
+        if (*ep == '*' || *ep == '?' || *ep == '-') { // accept empty?
+          p = ep + 1;
+          goto init;
+        }
+        s = NULL;
+        break;
+      }
+      switch (*ep) {
+      case '?': {
+        const char *res = match(ms, s + 1, ep + 1);
+        if (res != NULL) {
+          s = res;
+        } else {
+          p = ep + 1;
+          goto init;
+        }
+        break;
+      }
+      case '+':
+        s++; // 1 match already done
+        [[fallthrough]];
+      case '*':
+        s = max_expand(ms, s, p, ep);
+        break;
+      case '-':
+        s = min_expand(ms, s, p, ep);
+        break;
+      default:
+        s++;
+        p = ep;
+        goto init;
+      }
+      break;
+    }
+    }
+  }
+  ms->matchdepth++;
+  return s;
+}
+
+static void push_one_capture(PatternState *ms, int i, const char *s, const char *e) {
+  if (i >= ms->level) {
+    if (i != 0) luaL_error(ms->L, "invalid capture index %%%d", i + 1);
+    lua_pushlstring(ms->L, s, e - s); // add whole match
+    return;
+  }
+  ptrdiff_t len = ms->capture[i].len;
+  if (len == CAP_UNFINISHED) luaL_error(ms->L, "unfinished capture");
+  if (len == CAP_POSITION) lua_pushinteger(ms->L, (ms->capture[i].init - ms->src_init) + 1);
+  else lua_pushlstring(ms->L, ms->capture[i].init, len);
+}
+
+int pattern_push_captures(PatternState *ms, const char *s, const char *e) {
+  int nlevels = (ms->level == 0 && s) ? 1 : ms->level;
+  luaL_checkstack(ms->L, nlevels, "too many captures");
+  for (int i = 0; i < nlevels; i++) push_one_capture(ms, i, s, e);
+  return nlevels;
+}
+
+bool pattern_is_plain(const char *p, size_t lp) {
+  // The pattern may hold NULs, so check each piece between them
+  size_t upto = 0;
+  do {
+    if (strpbrk(p + upto, SPECIALS)) return false;
+    upto += strlen(p + upto) + 1;
+  } while (upto <= lp);
+  return true;
+}
+
+const char *pattern_memfind(const char *s, size_t ls, const char *p, size_t lp) {
+  if (lp == 0) return s; // empty strings are everywhere
+  if (lp > ls) return NULL;
+
+  // First char is found with memchr, then the rest compared
+  lp--;
+  ls -= lp;
+  const char *init;
+  while (ls > 0 && (init = scan__memchr(s, *p, ls)) != NULL) {
+    init++;
+    if (memcmp(init, p + 1, lp) == 0) return init - 1;
+    ls -= init - s;
+    s = init;
+  }
+  return NULL;
+}
+
+void pattern_prepare(PatternState *ms, lua_State *L, const char *s, size_t ls, const char *p, size_t lp) {
+  ms->L = L;
+  ms->matchdepth = MAXCCALLS;
+  ms->src_init = s;
+  ms->src_end = s + ls;
+  ms->p_end = p + lp;
+  ms->level = 0;
+}
+
+const char *pattern_match(PatternState *ms, const char *s, const char *p) {
+  ms->level = 0;
+  ms->matchdepth = MAXCCALLS;
+  return match(ms, s, p);
+}
+
+int pattern_find(lua_State *L, const char *s, size_t ls, const char *p, size_t lp, lua_Integer init, bool plain) {
+  // Same relative positions as string.find
+  size_t start;
+  if (init > 0) start = init;
+  else if (init == 0 || init < -(lua_Integer)ls) start = 1;
+  else start = ls + init + 1;
+  start--;
+  if (start > ls) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  if (plain || pattern_is_plain(p, lp)) {
+    const char *found = pattern_memfind(s + start, ls - start, p, lp);
+    if (found == NULL) {
+      lua_pushnil(L);
+      return 1;
+    }
+    lua_pushinteger(L, (found - s) + 1);
+    lua_pushinteger(L, (found - s) + lp);
+    return 2;
+  }
+
+  bool anchor = (*p == '^');
+  if (anchor) {
+    p++;
+    lp--;
+  }
+
+  PatternState ms;
+  pattern_prepare(&ms, L, s, ls, p, lp);
+  const char *s1 = s + start;
+  do {
+    const char *res = pattern_match(&ms, s1, p);
+    if (res != NULL) {
+      lua_pushinteger(L, (s1 - s) + 1);
+      lua_pushinteger(L, res - s);
+      return pattern_push_captures(&ms, NULL, 0) + 2;
+    }
+  } while (s1++ < ms.src_end && !anchor);
+
+  lua_pushnil(L);
+  return 1;
+}
@@ -0,0 +1,47 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <lua.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Lua pattern matching over any span of memory, not only lua strings, so
+// subjects like a mapped file never have to be copied into lua first
+
+#define PATTERN_MAXCAPTURES 32
+
+typedef struct {
+  const char *src_init; // start of the subject
+  const char *src_end;  // end of the subject, NEVER read
+  const char *p_end;    // end of the pattern
+  lua_State *L;         // malformed patterns raise lua errors here
+  int matchdepth;
+  int level; // captures in use
+  struct {
+    const char *init;
+    ptrdiff_t len;
+  } capture[PATTERN_MAXCAPTURES];
+} PatternState;
+
+// True if `p` has no magic characters and can be searched for as is
+bool pattern_is_plain(const char *p, size_t lp);
+
+// Finds the first occurrence of `p` in `s`, or NULL
+const char *pattern_memfind(const char *s, size_t ls, const char *p, size_t lp);
+
+// Readies `ms` to match patterns against the subject `s`
+void pattern_prepare(PatternState *ms, lua_State *L, const char *s, size_t ls, const char *p, size_t lp);
+
+// Matches `p` (without any leading '^') at exactly `s`, returning the end of
+// the match or NULL
+const char *pattern_match(PatternState *ms, const char *s, const char *p);
+
+// Pushes the captures of the last match, or the whole match between `s` and
+// `e` if there were none (pass NULL to push nothing then). Returns how many
+int pattern_push_captures(PatternState *ms, const char *s, const char *e);
+
+// string.find over `s`, pushing its results onto the stack. `init` is the
+// 1-based start (negative counts from the end). Returns how many were pushed
+int pattern_find(lua_State *L, const char *s, size_t ls, const char *p, size_t lp, lua_Integer init, bool plain);
+
+#endif
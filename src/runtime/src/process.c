@@ -19,6 +19,9 @@ typedef struct {
   char *redirect_out;
   const char **args;
   int args_len;
+  int pipe_size; // 0 leaves it to the process manager's default
+  int pipe_max;
+  bool heap_pipe; // stdout's ring lives in the process' own memory, see pipe.h
 } process__create_opts;
 
 int lprocess__create(lua_State *L) {
@@ -37,6 +40,9 @@ int lprocess__create(lua_State *L) {
     .redirect_out = NULL,
     .args = NULL,
     .args_len = 0,
+    .pipe_size = 0,
+    .pipe_max = 0,
+    .heap_pipe = false,
   };
 
   if (lua_istable(L, 2)) {
@@ -72,6 +78,30 @@ int lprocess__create(lua_State *L) {
       }
     }
 
+    lua_getfield(L, 2, "pipe_size");
+    if (lua_isnil(L, -1)) lua_pop(L, 1);
+    else {
+      lua_Integer size = luaL_checkinteger(L, -1);
+      // One slot is always kept empty, so a single byte couldn't hold any data
+      luaL_argcheck(L, size >= 2, 2, "pipe_size must be at least 2");
+      opts.pipe_size = size < PIPE_SIZE_MAX ? (int)size : PIPE_SIZE_MAX;
+    }
+
+    lua_getfield(L, 2, "pipe_max");
+    if (lua_isnil(L, -1)) lua_pop(L, 1);
+    else {
+      lua_Integer max = luaL_checkinteger(L, -1);
+      luaL_argcheck(L, max >= 2, 2, "pipe_max must be at least 2");
+      opts.pipe_max = max < PIPE_SIZE_MAX ? (int)max : PIPE_SIZE_MAX;
+      luaL_argcheck(L, opts.pipe_size == 0 || opts.pipe_max >= opts.pipe_size, 2, "pipe_max must not be less than pipe_size");
+    }
+
+    lua_getfield(L, 2, "heap_pipe");
+    if (lua_isnil(L, -1)) lua_pop(L, 1);
+    else {
+      opts.heap_pipe = checkboolean(L, -1);
+    }
+
     lua_getfield(L, 2, "argv");
     if (lua_isnil(L, -1)) lua_pop(L, 1);
     else {
@@ -106,7 +136,7 @@ int lprocess__create(lua_State *L) {
   }
 
   int len = strlen(opath);
-  int pid = proc__create(opath, len, opts.args, opts.args_len, opts.pipe_in, opts.pipe_out, opts.redirect_in, opts.redirect_out, cwd, &err);
+  int pid = proc__create(opath, len, opts.args, opts.args_len, opts.pipe_in, opts.pipe_out, opts.redirect_in, opts.redirect_out, cwd, opts.pipe_size, opts.pipe_max, opts.heap_pipe, &err);
   free(opath);
   if (opts.redirect_in != NULL) free(opts.redirect_in);
   if (opts.redirect_out != NULL) free(opts.redirect_out);
@@ -193,6 +223,25 @@ int lprocess__output(lua_State *L) {
   return 1;
 }
 
+// Unlike process.output, writes the string exactly as it is: no newline is
+// added and embedded zeros are kept
+int lprocess__output_bytes(lua_State *L) {
+  size_t len;
+  const char *to_output = luaL_checklstring(L, 1, &len);
+  luaL_argcheck(L, len <= INT_MAX, 1, "too long to output at once");
+
+  Error err = 0;
+  proc__output(to_output, (int)len, &err);
+
+  if (err != 0) {
+    lua_pushnumber(L, err);
+    return 1;
+  }
+
+  lua_pushnil(L);
+  return 1;
+}
+
 int lprocess__kill(lua_State *L) {
   int pid = luaL_checknumber(L, 1);
   Error err = 0;
@@ -341,6 +390,27 @@ int lprocess__input(lua_State *L) {
   return 2;
 }
 
+// NOTE: returns "" on EOF
+int lprocess__input_bytes(lua_State *L) {
+  lua_Integer max = luaL_optinteger(L, 1, BUFSIZ);
+  luaL_argcheck(L, max > 0 && max <= INT_MAX, 1, "max_bytes out of range");
+
+  luaL_Buffer b;
+  char *buf = luaL_buffinitsize(L, &b, max);
+
+  Error err = 0;
+  int n = proc__input_bytes(buf, (int)max, &err);
+  if (err != 0) {
+    lua_pushnil(L);
+    lua_pushnumber(L, err);
+    return 2;
+  }
+
+  luaL_pushresultsize(&b, n);
+  lua_pushnil(L);
+  return 2;
+}
+
 int lprocess__input_all(lua_State *L) {
   Error err = 0;
   char *read_bytes = proc__input_all(&err);
@@ -390,3 +460,20 @@ int lprocess__close_output(lua_State *L) {
   lua_pushnil(L);
   return 1;
 }
+
+int lprocess__output_buffering(lua_State *L) {
+  static const char *const modes[] = {"full", "line", "none", NULL};
+  static const int setvbuf_modes[] = {_IOFBF, _IOLBF, _IONBF};
+
+  int mode = setvbuf_modes[luaL_checkoption(L, 1, NULL, modes)];
+  int size = luaL_optinteger(L, 2, 0);
+
+  Error err = 0;
+  proc__set_output_buffering(mode, size, &err);
+  if (err != 0) {
+    lua_pushnumber(L, err);
+    return 1;
+  }
+  lua_pushnil(L);
+  return 1;
+}
@@ -1,9 +1,12 @@
 #include "rfile.h"
 #include "../../filesystem/src/file.h"
+#include "../../filesystem/src/scan.h"
+#include "pattern.h"
 #include "shared.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <lauxlib.h>
+#include <limits.h>
 #include <lua.h>
 #include <stdlib.h>
 #include <string.h>
@@ -84,14 +87,30 @@ int lfile__close(lua_State *L) {
 }
 
 /**
- * @@ file.write(fd: int, text: string) -> (err: number | nil)
+ * @@ file.write(fd: int, text: string, ...: string) -> (err: number | nil)
  */
 int lfile__write(lua_State *L) {
-  lua_settop(L, 2);
   int fd = luaL_checknumber(L, 1);
-  const char *content = luaL_checkstring(L, 2);
+  int count = lua_gettop(L) - 1;
+  luaL_checkstring(L, 2);
   Error err;
-  file__write(fd, content, &err);
+
+  if (count == 1) {
+    size_t len;
+    const char *content = lua_tolstring(L, 2, &len);
+    file__write_n(fd, content, len, &err);
+  } else {
+    // Hand every fragment to the filesystem as one vectored write, the slices
+    // point into the lua strings which stay alive on the stack until we return
+    WriteSlice *slices = lua_newuserdatauv(L, count * sizeof(WriteSlice), 0);
+    for (int i = 0; i < count; i++) {
+      size_t len;
+      slices[i].data = luaL_checklstring(L, i + 2, &len);
+      slices[i].size = len;
+    }
+    file__writev(fd, slices, count, &err);
+  }
+
   if (err != 0) {
     lua_pushnumber(L, err);
     return 1;
@@ -107,48 +126,332 @@ int lfile__write(lua_State *L) {
 int lfile__read(lua_State *L) {
   lua_settop(L, 2);
   int fd = luaL_checknumber(L, 1);
-  int amt = luaL_checknumber(L, 2);
-  ReadResult rr;
+  Offset amt = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, amt >= 0, 2, "amount must not be negative");
+  // A buffer bigger than what's left would go unused
+  if (amt > CHUNK_SIZE) {
+    Offset remaining = file__remaining(fd);
+    if (remaining >= 0 && amt > remaining) amt = remaining;
+  }
+  luaL_argcheck(L, amt <= INT_MAX, 2, "amount is too large to read at once");
+
+  // Read straight into lua's buffer rather than a malloc'd intermediate, small
+  // reads never touch the heap as they fit in the buffer's stack storage
+  luaL_Buffer b;
+  char *buf = luaL_buffinitsize(L, &b, amt);
   Error err;
-  file__read(fd, amt, &rr, &err);
-  if (err != 0) {
+  int amount_read = file__read_chunk(fd, buf, amt, &err);
+  if (amount_read < 0) {
     lua_pushnil(L);
     lua_pushnumber(L, err);
     return 2;
   }
-  lua_pushlstring(L, rr.data, rr.size);
-  free(rr.data); // safe to free as lua does not own/borrow the memory
+  luaL_pushresultsize(&b, amount_read);
   lua_pushnil(L);
   return 2;
 }
 
+/**
+ * @@ file.read_at(fd: int, offset: int, amt: int) -> (read: string | nil, err: number | nil)
+ */
+int lfile__read_at(lua_State *L) {
+  lua_settop(L, 3);
+  int fd = luaL_checknumber(L, 1);
+  Offset offset = luaL_checkinteger(L, 2);
+  lua_Integer amt = luaL_checkinteger(L, 3);
+  luaL_argcheck(L, offset >= 0, 2, "offset must not be negative");
+  luaL_argcheck(L, amt >= 0, 3, "amount must not be negative");
+  luaL_argcheck(L, amt <= INT_MAX, 3, "amount is too large to read at once");
+
+  luaL_Buffer b;
+  char *buf = luaL_buffinitsize(L, &b, amt);
+  Error err;
+  int amount_read = file__pread(fd, buf, amt, offset, &err);
+  if (amount_read < 0) {
+    lua_pushnil(L);
+    lua_pushnumber(L, err);
+    return 2;
+  }
+  luaL_pushresultsize(&b, amount_read);
+  lua_pushnil(L);
+  return 2;
+}
+
+/**
+ * @@ file.write_at(fd: int, offset: int, text: string) -> (err: number | nil)
+ */
+int lfile__write_at(lua_State *L) {
+  lua_settop(L, 3);
+  int fd = luaL_checknumber(L, 1);
+  Offset offset = luaL_checkinteger(L, 2);
+  size_t len;
+  const char *content = luaL_checklstring(L, 3, &len);
+  luaL_argcheck(L, offset >= 0, 2, "offset must not be negative");
+
+  Error err;
+  file__pwrite(fd, content, len, offset, &err);
+  if (err != 0) {
+    lua_pushnumber(L, err);
+    return 1;
+  }
+  lua_pushnil(L);
+  return 1;
+}
+
 /**
  * @@ file.read_all(fd: int) -> (read: string | nil, err: number | nil)
  */
 int lfile__read_all(lua_State *L) {
   lua_settop(L, 1);
   int fd = luaL_checknumber(L, 1);
+
+  // Size the first read from what's left of the file, one byte over so the
+  // short read tells us we hit EOF without needing to grow the buffer
+  Offset remaining = file__remaining(fd);
+  size_t want = CHUNK_SIZE;
+  if (remaining >= 0 && remaining < INT_MAX) want = remaining + 1;
+
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  Error err;
+  while (true) {
+    char *buf = luaL_prepbuffsize(&b, want);
+    int amount_read = file__read_chunk(fd, buf, want, &err);
+    if (amount_read < 0) {
+      lua_pushnil(L);
+      lua_pushnumber(L, err);
+      return 2;
+    }
+    luaL_addsize(&b, amount_read);
+    if ((size_t)amount_read < want) break;
+    want = CHUNK_SIZE;
+  }
+  luaL_pushresult(&b);
+  lua_pushnil(L);
+  return 2;
+}
+
+/**
+ * @@ file.read_line(fd: int) -> (line: string | nil, err: number | nil)
+ */
+int lfile__read_line(lua_State *L) {
+  lua_settop(L, 1);
+  int fd = luaL_checknumber(L, 1);
   ReadResult rr;
   Error err;
-  file__read_all(fd, &rr, &err);
+  file__read_line(fd, &rr, &err);
   if (err != 0) {
     lua_pushnil(L);
     lua_pushnumber(L, err);
     return 2;
   }
-  lua_pushlstring(L, rr.data, rr.size);
+  // EOF
+  if (rr.data == NULL) {
+    lua_pushnil(L);
+    lua_pushnil(L);
+    return 2;
+  }
+  // Like io.read("l"), hand the line back without its newline
+  int len = rr.size;
+  if (len > 0 && rr.data[len - 1] == '\n') len--;
+  lua_pushlstring(L, rr.data, len);
   free(rr.data);
   lua_pushnil(L);
   return 2;
 }
 
+#define MAP_METATABLE "file.map"
+
+// A file mapped by file.map
+typedef struct {
+  const char *data; // NULL when empty or closed
+  size_t len;
+  bool closed;
+} LMap;
+
+static LMap *check_map(lua_State *L) {
+  LMap *map = luaL_checkudata(L, 1, MAP_METATABLE);
+  if (map->closed) luaL_error(L, "attempt to use a closed file map");
+  return map;
+}
+
+// Never NULL, so an empty map still looks like an empty string
+static const char *map_data(LMap *map) { return map->data ? map->data : ""; }
+
+static int lmap__close(lua_State *L) {
+  LMap *map = luaL_checkudata(L, 1, MAP_METATABLE);
+  if (!map->closed) file__unmap(map->data, map->len);
+  map->data = NULL;
+  map->closed = true;
+  return 0;
+}
+
+static int lmap__len(lua_State *L) {
+  lua_pushinteger(L, check_map(L)->len);
+  return 1;
+}
+
+// map:sub(i, j), with the same relative positions as string.sub
+static int lmap__sub(lua_State *L) {
+  LMap *map = check_map(L);
+  lua_Integer len = map->len;
+  lua_Integer i = luaL_checkinteger(L, 2);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+
+  if (i < 0) i = i < -len ? 1 : len + i + 1;
+  else if (i == 0) i = 1;
+  if (j < 0) j = j < -len ? 0 : len + j + 1;
+  else if (j > len) j = len;
+
+  if (i > j) lua_pushliteral(L, "");
+  else lua_pushlstring(L, map_data(map) + i - 1, j - i + 1);
+  return 1;
+}
+
+// map:find(pattern, init, plain), as string.find but without the copy
+static int lmap__find(lua_State *L) {
+  LMap *map = check_map(L);
+  size_t lp;
+  const char *p = luaL_checklstring(L, 2, &lp);
+  lua_Integer init = luaL_optinteger(L, 3, 1);
+  bool plain = lua_toboolean(L, 4);
+  return pattern_find(L, map_data(map), map->len, p, lp, init, plain);
+}
+
+static int lmap__lines_next(lua_State *L) {
+  LMap *map = lua_touserdata(L, lua_upvalueindex(1));
+  if (map->closed) return luaL_error(L, "attempt to use a closed file map");
+
+  size_t pos = lua_tointeger(L, lua_upvalueindex(2));
+  if (pos >= map->len) return 0;
+
+  const char *start = map->data + pos;
+  const char *nl = scan__memchr(start, '\n', map->len - pos);
+  size_t line_len = nl ? (size_t)(nl - start) : map->len - pos;
+
+  lua_pushinteger(L, pos + line_len + 1);
+  lua_replace(L, lua_upvalueindex(2));
+  lua_pushlstring(L, start, line_len);
+  return 1;
+}
+
+// map:lines(), each line without its newline
+static int lmap__lines(lua_State *L) {
+  check_map(L);
+  lua_settop(L, 1);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, lmap__lines_next, 2);
+  return 1;
+}
+
+static const luaL_Reg map_methods[] = {
+  {"sub", lmap__sub},
+  {"find", lmap__find},
+  {"lines", lmap__lines},
+  {"close", lmap__close},
+  {"__len", lmap__len},
+  {"__gc", lmap__close},
+  {"__close", lmap__close},
+  {NULL, NULL},
+};
+
+/**
+ * @@ file.map(path: string) -> (map: File_Map | nil, err: number | nil)
+ *
+ * map:sub(i, j), map:find(pattern, init, plain), map:lines(), map:close(), #map
+ */
+int lfile__map(lua_State *L) {
+  lua_settop(L, 1);
+  const char *path = luaL_checkstring(L, 1);
+
+  char *fpath = fake_path(path);
+  if (fpath == NULL) {
+    lua_pushnil(L);
+    lua_pushnumber(L, E_DOESNTEXIST);
+    return 2;
+  }
+
+  // Made before mapping, so a failed allocation can't leak the mapping
+  LMap *map = lua_newuserdatauv(L, sizeof(*map), 0);
+  *map = (LMap){.data = NULL, .len = 0, .closed = true};
+  if (luaL_newmetatable(L, MAP_METATABLE)) {
+    luaL_setfuncs(L, map_methods, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+  }
+  lua_setmetatable(L, -2);
+
+  Error err;
+  size_t len;
+  const char *data = file__map(fpath, &len, &err);
+  free(fpath);
+  if (err != 0) {
+    lua_pushnil(L);
+    lua_pushnumber(L, err);
+    return 2;
+  }
+  *map = (LMap){.data = data, .len = len, .closed = false};
+
+  lua_pushnil(L);
+  return 2;
+}
+
+// The bytes of a string or File_Map argument
+static const char *check_bytes(lua_State *L, int arg, size_t *len) {
+  LMap *map = luaL_testudata(L, arg, MAP_METATABLE);
+  if (map == NULL) return luaL_checklstring(L, arg, len);
+  if (map->closed) luaL_error(L, "attempt to use a closed file map");
+  *len = map->len;
+  return map_data(map);
+}
+
+/**
+ * @@ file.count_lines(subject: string | File_Map) -> (count: number)
+ *
+ * Counts lines as map:lines() would yield them, a final line without a
+ * newline counts too
+ */
+int lfile__count_lines(lua_State *L) {
+  size_t len;
+  const char *s = check_bytes(L, 1, &len);
+  size_t count = scan__count_byte(s, '\n', len);
+  if (len > 0 && s[len - 1] != '\n') count++;
+  lua_pushinteger(L, count);
+  return 1;
+}
+
+/**
+ * @@ file.index_of(subject: string | File_Map, bytes: string, init?: number) -> (index: number | nil)
+ *
+ * Position of the first byte at or after `init` that is any of `bytes`
+ */
+int lfile__index_of(lua_State *L) {
+  size_t len, set_len;
+  const char *s = check_bytes(L, 1, &len);
+  const char *set = luaL_checklstring(L, 2, &set_len);
+  lua_Integer init = luaL_optinteger(L, 3, 1);
+
+  // Same relative positions as string.find
+  if (init < 0) init = init < -(lua_Integer)len ? 1 : (lua_Integer)len + init + 1;
+  else if (init == 0) init = 1;
+  if (init > (lua_Integer)len) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  const char *found = scan__find_any(s + init - 1, len - (init - 1), set, set_len);
+  if (found == NULL) lua_pushnil(L);
+  else lua_pushinteger(L, found - s + 1);
+  return 1;
+}
+
 /**
  * @@ file.shift(fd: int, amt: int) -> (err: number | nil)
  */
 int lfile__shift(lua_State *L) {
   lua_settop(L, 2);
   int fd = luaL_checknumber(L, 1);
-  int amt = luaL_checknumber(L, 2);
+  Offset amt = luaL_checkinteger(L, 2);
   Error err;
   file__shift(fd, amt, &err);
   if (err != 0) {
@@ -165,7 +468,7 @@ int lfile__shift(lua_State *L) {
 int lfile__goto(lua_State *L) {
   lua_settop(L, 2);
   int fd = luaL_checknumber(L, 1);
-  int pos = luaL_checknumber(L, 2);
+  Offset pos = luaL_checkinteger(L, 2);
   Error err;
   file__goto(fd, pos, &err);
   if (err != 0) {
@@ -201,6 +504,33 @@ cleanup:
   return 1;
 }
 
+/**
+ * @@ file.replace_contents(path: string, text: string) -> (err: number | nil)
+ */
+int lfile__replace_contents(lua_State *L) {
+  lua_settop(L, 2);
+  const char *path = luaL_checkstring(L, 1);
+  size_t len;
+  const char *content = luaL_checklstring(L, 2, &len);
+
+  char *fpath = fake_path(path);
+  if (fpath == NULL) {
+    lua_pushnumber(L, E_DOESNTEXIST);
+    return 1;
+  }
+
+  Error err;
+  file__replace_contents(fpath, content, len, &err);
+  if (err != 0) {
+    lua_pushnumber(L, err);
+    goto cleanup;
+  }
+  lua_pushnil(L);
+cleanup:
+  free(fpath);
+  return 1;
+}
+
 /**
  * @@ file.move(old_path: string, new_path: string) -> (err: number | nil)
  */
@@ -236,6 +566,49 @@ cleanup:
   return 1;
 }
 
+// Runs a file__ call taking a source and destination path, as file.move does
+static int two_path_op(lua_State *L, void (*op)(const char *restrict, const char *restrict, Error *restrict)) {
+  lua_settop(L, 2);
+  const char *src_path = luaL_checkstring(L, 1);
+  const char *dst_path = luaL_checkstring(L, 2);
+
+  char *src_fpath = fake_path(src_path);
+  if (src_fpath == NULL) {
+    lua_pushnumber(L, E_DOESNTEXIST);
+    return 1;
+  }
+
+  char *dst_fpath = fake_path(dst_path);
+  if (dst_fpath == NULL) {
+    lua_pushnumber(L, E_DOESNTEXIST);
+    free(src_fpath);
+    return 1;
+  }
+
+  Error err;
+  op(src_fpath, dst_fpath, &err);
+  if (err != 0) {
+    lua_pushnumber(L, err);
+    goto cleanup;
+  }
+  lua_pushnil(L);
+
+cleanup:
+  free(dst_fpath);
+  free(src_fpath);
+  return 1;
+}
+
+/**
+ * @@ file.copy(src_path: string, dst_path: string) -> (err: number | nil)
+ */
+int lfile__copy(lua_State *L) { return two_path_op(L, file__copy); }
+
+/**
+ * @@ file.copy_tree(src_path: string, dst_path: string) -> (err: number | nil)
+ */
+int lfile__copy_tree(lua_State *L) { return two_path_op(L, file__copy_tree); }
+
 /**
  * @@ file.make_dir(dir_path: string) -> (err: number | nil)
  */
@@ -288,9 +661,9 @@ cleanup:
 }
 
 /**
- * @@ file.change_dir(dir_path: string) -> (err: number | nil)
+ * @@ file.remove_tree(path: string) -> (err: number | nil)
  */
-int lfile__change_dir(lua_State *L) {
+int lfile__remove_tree(lua_State *L) {
   lua_settop(L, 1);
   const char *path = luaL_checkstring(L, 1);
 
@@ -301,7 +674,7 @@ int lfile__change_dir(lua_State *L) {
   }
 
   Error err;
-  file__change_dir(fpath, &err);
+  file__remove_tree(fpath, &err);
   if (err != 0) {
     lua_pushnumber(L, err);
     goto cleanup;
@@ -313,57 +686,39 @@ cleanup:
 }
 
 /**
- * @@ file.read_dir(dir_path: string) -> (entries: string[], err: number | nil)
+ * @@ file.change_dir(dir_path: string) -> (err: number | nil)
  */
-int lfile__read_dir(lua_State *L) {
-  char **entries = NULL;
-  char *fpath = NULL;
-
-  lua_settop(L, 2);
+int lfile__change_dir(lua_State *L) {
+  lua_settop(L, 1);
   const char *path = luaL_checkstring(L, 1);
 
-  fpath = fake_path(path);
+  char *fpath = fake_path(path);
   if (fpath == NULL) {
-    lua_pushnil(L);
     lua_pushnumber(L, E_DOESNTEXIST);
     goto cleanup;
   }
 
-  Error err = 0;
-  lua_newtable(L);
-
-  entries = file__read_dir(fpath, &err);
+  Error err;
+  file__change_dir(fpath, &err);
   if (err != 0) {
-    lua_pushnil(L);
     lua_pushnumber(L, err);
     goto cleanup;
   }
-
-  int idx = 0;
-  while (*(entries + idx) != NULL) {
-    char *entry = *(entries + idx);
-    lua_pushstring(L, entry);
-    free(entry);
-    lua_pushnumber(L, idx + 1);
-    lua_insert(L, -2);
-    lua_settable(L, -3);
-    idx++;
-  }
-
+  // Relative paths resolved so far were relative to the old CWD
+  path_cache_invalidate();
   lua_pushnil(L);
 cleanup:
-  free(entries);
   free(fpath);
-  return 2;
+  return 1;
 }
 
 void statr_as_l(lua_State *L, StatResult *sr) {
   lua_createtable(L, 0, 8);
 
-  lua_pushnumber(L, sr->size);
+  lua_pushinteger(L, sr->size);
   lua_setfield(L, -2, "size");
 
-  lua_pushnumber(L, sr->blocks);
+  lua_pushinteger(L, sr->blocks);
   lua_setfield(L, -2, "blocks");
 
   lua_pushnumber(L, sr->blocksize);
@@ -405,7 +760,7 @@ void statr_as_l(lua_State *L, StatResult *sr) {
         (Time *)(srr +
                  time_offsets[i]); // then just extract the field by byte offset
 
-    lua_pushnumber(L, time->sec);
+    lua_pushinteger(L, time->sec);
     lua_setfield(L, -2, "sec");
     lua_pushnumber(L, time->nsec);
     lua_setfield(L, -2, "nsec");
@@ -414,6 +769,240 @@ void statr_as_l(lua_State *L, StatResult *sr) {
   }
 }
 
+/**
+ * @@ file.read_dir(dir_path: string, opts?: { stat: boolean }) -> (entries: string[] | { name: string, stat: File_Status }[], err: number | nil)
+ */
+int lfile__read_dir(lua_State *L) {
+  char **entries = NULL;
+  DirListing *listing = NULL;
+  char *fpath = NULL;
+
+  lua_settop(L, 2);
+  const char *path = luaL_checkstring(L, 1);
+
+  bool with_stat = false;
+  if (lua_istable(L, 2)) {
+    lua_getfield(L, 2, "stat");
+    with_stat = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+  }
+
+  fpath = fake_path(path);
+  if (fpath == NULL) {
+    lua_pushnil(L);
+    lua_pushnumber(L, E_DOESNTEXIST);
+    goto cleanup;
+  }
+
+  Error err = 0;
+
+  // Names and stats come back together, rather than a stat call per entry
+  if (with_stat) {
+    listing = file__read_dir_plus(fpath, &err);
+    if (err != 0) {
+      lua_pushnil(L);
+      lua_pushnumber(L, err);
+      goto cleanup;
+    }
+
+    lua_createtable(L, listing->count, 0);
+    for (int i = 0; i < listing->count; i++) {
+      lua_createtable(L, 0, 2);
+      lua_pushstring(L, listing->names[i]);
+      lua_setfield(L, -2, "name");
+      // Left nil for entries that couldn't be stat'ed
+      if (listing->stats[i].type != -1) {
+        statr_as_l(L, &listing->stats[i]);
+        lua_setfield(L, -2, "stat");
+      }
+      lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_pushnil(L);
+    goto cleanup;
+  }
+
+  lua_newtable(L);
+
+  entries = file__read_dir(fpath, &err);
+  if (err != 0) {
+    lua_pushnil(L);
+    lua_pushnumber(L, err);
+    goto cleanup;
+  }
+
+  int idx = 0;
+  while (*(entries + idx) != NULL) {
+    char *entry = *(entries + idx);
+    lua_pushstring(L, entry);
+    lua_pushnumber(L, idx + 1);
+    lua_insert(L, -2);
+    lua_settable(L, -3);
+    idx++;
+  }
+
+  lua_pushnil(L);
+cleanup:
+  free(listing);
+  free(entries);
+  free(fpath);
+  return 2;
+}
+
+#define WALK_METATABLE "file.walk"
+
+// State behind the userdata file.walk hands to a generic for
+typedef struct {
+  Walk *walk;
+  lua_State *L; // the thread currently stepping, for the prune callback
+  int prune;    // registry ref, or LUA_NOREF
+  int root_len; // length of the resolved root, swapped for the path given
+} LWalk;
+
+static void lwalk_close(lua_State *L, LWalk *lw) {
+  file__walk_close(lw->walk);
+  lw->walk = NULL;
+  luaL_unref(L, LUA_REGISTRYINDEX, lw->prune);
+  lw->prune = LUA_NOREF;
+}
+
+static int lwalk__gc(lua_State *L) {
+  lwalk_close(L, luaL_checkudata(L, 1, WALK_METATABLE));
+  return 0;
+}
+
+// Pushes the entry's path as the caller would have written it, the path they
+// passed in followed by whatever the walk appended to the resolved root
+static void lwalk_push_path(lua_State *L, LWalk *lw, int ud, const WalkEntry *entry) {
+  lua_getiuservalue(L, ud, 1);
+  size_t len;
+  const char *root = lua_tolstring(L, -1, &len);
+  const char *rest = entry->path + lw->root_len;
+  if (*rest == '/' && len > 0 && root[len - 1] == '/') rest++;
+
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  luaL_addlstring(&b, root, len);
+  luaL_addstring(&b, rest);
+  luaL_pushresult(&b);
+  lua_remove(L, -2);
+}
+
+static bool lwalk_prune(const WalkEntry *entry, void *ud) {
+  LWalk *lw = ud;
+  lua_State *L = lw->L;
+  // The userdata sits at index 1 while the iterator runs
+  lua_rawgeti(L, LUA_REGISTRYINDEX, lw->prune);
+  lwalk_push_path(L, lw, 1, entry);
+  statr_as_l(L, (StatResult *)&entry->stat);
+  lua_pushinteger(L, entry->depth);
+  lua_call(L, 3, 1);
+  bool prune = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  return prune;
+}
+
+static int lwalk__next(lua_State *L) {
+  LWalk *lw = luaL_checkudata(L, 1, WALK_METATABLE);
+  lua_settop(L, 1);
+  if (lw->walk == NULL) return 0;
+
+  lw->L = L;
+  Error err = 0;
+  const WalkEntry *entry = file__walk_next(lw->walk, &err);
+  if (err != 0) {
+    lwalk_close(L, lw);
+    return luaL_error(L, "file.walk failed: %d", err);
+  }
+  if (entry == NULL) {
+    lwalk_close(L, lw);
+    return 0;
+  }
+
+  lwalk_push_path(L, lw, 1, entry);
+  // A node that couldn't be stat'ed or opened comes with its error instead of
+  // ending the loop
+  if (entry->stat.type == -1) lua_pushnil(L);
+  else statr_as_l(L, (StatResult *)&entry->stat);
+  lua_pushinteger(L, entry->depth);
+  if (entry->error != 0) lua_pushnumber(L, entry->error);
+  else lua_pushnil(L);
+  return 4;
+}
+
+/**
+ * @@ file.walk(path: string, opts?: { max_depth: number, type: number, prune: function }) -> (iterator, ...)
+ *
+ * for path, stat, depth, err in file.walk(path, opts) do ... end
+ */
+int lfile__walk(lua_State *L) {
+  lua_settop(L, 2);
+  const char *path = luaL_checkstring(L, 1);
+
+  WalkOptions opts = {.max_depth = -1, .types = WALK_FILES | WALK_DIRS};
+  int prune = LUA_NOREF;
+  if (lua_istable(L, 2)) {
+    lua_getfield(L, 2, "max_depth");
+    if (!lua_isnil(L, -1)) opts.max_depth = luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+
+    lua_getfield(L, 2, "type");
+    if (!lua_isnil(L, -1))
+      opts.types = luaL_checkinteger(L, -1) == 1 ? WALK_DIRS : WALK_FILES;
+    lua_pop(L, 1);
+
+    lua_getfield(L, 2, "prune");
+    if (!lua_isnil(L, -1)) {
+      luaL_checktype(L, -1, LUA_TFUNCTION);
+      prune = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else {
+      lua_pop(L, 1);
+    }
+  }
+
+  LWalk *lw = lua_newuserdatauv(L, sizeof(*lw), 1);
+  *lw = (LWalk){.walk = NULL, .L = L, .prune = prune, .root_len = 0};
+  if (luaL_newmetatable(L, WALK_METATABLE)) {
+    lua_pushcfunction(L, lwalk__gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pushcfunction(L, lwalk__gc);
+    lua_setfield(L, -2, "__close");
+  }
+  lua_setmetatable(L, -2);
+  lua_pushvalue(L, 1);
+  lua_setiuservalue(L, -2, 1);
+
+  char *fpath = fake_path(path);
+  if (fpath == NULL) {
+    lua_pushnil(L);
+    lua_pushnumber(L, E_DOESNTEXIST);
+    return 2;
+  }
+
+  if (prune != LUA_NOREF) {
+    opts.prune = lwalk_prune;
+    opts.ud = lw;
+  }
+
+  Error err = 0;
+  lw->walk = file__walk_open(fpath, &opts, &err);
+  lw->root_len = strlen(fpath);
+  free(fpath);
+  if (err != 0) {
+    lua_pushnil(L);
+    lua_pushnumber(L, err);
+    return 2;
+  }
+
+  // The userdata doubles as the to-be-closed value, so breaking out of the
+  // loop releases the open directories straight away
+  lua_pushcfunction(L, lwalk__next);
+  lua_insert(L, -2);
+  lua_pushnil(L);
+  lua_pushvalue(L, -2);
+  return 4;
+}
+
 /**
  * @@ file.stat(path: string) -> (sr: StatResult | nil, err: number | nil)
  *
@@ -467,6 +1056,27 @@ cleanup:
   return 2;
 }
 
+/**
+ * @@ file.cache_stats() -> {hits, misses, invalidations, entries, capacity}
+ */
+int lfile__cache_stats(lua_State *L) {
+  MetadataCacheStats stats;
+  file__cache_stats(&stats);
+
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, stats.hits);
+  lua_setfield(L, -2, "hits");
+  lua_pushinteger(L, stats.misses);
+  lua_setfield(L, -2, "misses");
+  lua_pushinteger(L, stats.invalidations);
+  lua_setfield(L, -2, "invalidations");
+  lua_pushinteger(L, stats.entries);
+  lua_setfield(L, -2, "entries");
+  lua_pushinteger(L, stats.capacity);
+  lua_setfield(L, -2, "capacity");
+  return 1;
+}
+
 /**
  * @@ file.fdstat(fd: number) -> (sr: StatResult | nil, err: number | nil)
  *
@@ -550,9 +1160,12 @@ cleanup:
   return 1;
 }
 
+/**
+ * @@ file.truncate(fd: int, length: int) -> (err: number | nil)
+ */
 int lfile__truncate(lua_State *L) {
   int fd = luaL_checknumber(L, 1);
-  int length = luaL_checknumber(L, 2);
+  Offset length = luaL_checkinteger(L, 2);
   luaL_argcheck(L, length >= 0, 2, "length must be 0 or more");
 
   Error err = 0;
@@ -566,6 +1179,26 @@ int lfile__truncate(lua_State *L) {
   return 1;
 }
 
+/**
+ * @@ file.reserve(fd: int, size: int) -> (err: number | nil)
+ */
+int lfile__reserve(lua_State *L) {
+  lua_settop(L, 2);
+  int fd = luaL_checknumber(L, 1);
+  Offset size = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, size >= 0, 2, "size must be 0 or more");
+
+  Error err;
+  file__reserve(fd, size, &err);
+  if (err != 0) {
+    lua_pushnumber(L, err);
+    return 1;
+  }
+
+  lua_pushnil(L);
+  return 1;
+}
+
 int lfile__cwd(lua_State *L) {
   Error err = 0;
   char *cwd = file__cwd(&err);
@@ -7,19 +7,32 @@ int lfile__open(lua_State *L);
 int lfile__close(lua_State *L);
 int lfile__write(lua_State *L);
 int lfile__read(lua_State *L);
+int lfile__read_at(lua_State *L);
+int lfile__write_at(lua_State *L);
 int lfile__read_all(lua_State *L);
+int lfile__read_line(lua_State *L);
+int lfile__map(lua_State *L);
+int lfile__count_lines(lua_State *L);
+int lfile__index_of(lua_State *L);
 int lfile__shift(lua_State *L);
 int lfile__goto(lua_State *L);
 int lfile__remove(lua_State *L);
+int lfile__replace_contents(lua_State *L);
 int lfile__move(lua_State *L);
+int lfile__copy(lua_State *L);
+int lfile__copy_tree(lua_State *L);
 int lfile__make_dir(lua_State *L);
 int lfile__remove_dir(lua_State *L);
+int lfile__remove_tree(lua_State *L);
 int lfile__change_dir(lua_State *L);
 int lfile__read_dir(lua_State *L);
+int lfile__walk(lua_State *L);
 int lfile__stat(lua_State *L);
 int lfile__fdstat(lua_State *L);
+int lfile__cache_stats(lua_State *L);
 int lfile__permit(lua_State *L);
 int lfile__truncate(lua_State *L);
+int lfile__reserve(lua_State *L);
 int lfile__cwd(lua_State *L);
 
 #endif
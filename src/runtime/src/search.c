@@ -0,0 +1,411 @@
+#include "search.h"
+#include "../../filesystem/src/file.h"
+#include "../../filesystem/src/scan.h"
+#include "pattern.h"
+#include "shared.h"
+#include <ctype.h>
+#include <lauxlib.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Searches whole files for the lines that match, without handing each line
+// to lua. Plain patterns are found with the scan kernels over the whole file
+// at once, other patterns are matched a line at a time but only where they
+// could start
+
+#define SCAN_METATABLE "search.scan"
+
+// Matches handed to lua at once unless asked otherwise
+#define DEFAULT_BATCH 256
+
+// One of the patterns being searched for
+typedef struct {
+  const char *p; // without any leading '^', kept alive by the scan's user value
+  size_t lp;
+  bool plain;       // searched for as is, across lines
+  bool anchor;      // only matches at the start of a line
+  int first;        // the byte every match starts with, or -1 when it can't be known
+  bool searched;    // whether `hit` is up to date
+  const char *hit;  // the next match at or after the scan's position, NULL when there are none left
+  const char *hit_end;
+} Needle;
+
+// A search made by search.scan
+typedef struct {
+  const char *data; // NULL when empty or closed
+  size_t len;
+  char *folded; // the lowercased copy that's searched when ignoring case
+  bool closed;
+  bool invert;
+  lua_Integer batch;
+  lua_Integer limit;   // how many more lines to report, negative for no limit
+  size_t pos;          // start of the next line to search
+  lua_Integer line_no; // of the line at `pos`
+  int count;
+  Needle needles[];
+} LScan;
+
+static LScan *check_scan(lua_State *L) {
+  LScan *scan = luaL_checkudata(L, 1, SCAN_METATABLE);
+  if (scan->closed) luaL_error(L, "attempt to use a closed search");
+  return scan;
+}
+
+// Never NULL, so an empty file still looks like an empty string
+static const char *scan_data(LScan *scan) { return scan->data ? scan->data : ""; }
+
+// What's searched, which only differs from the file when ignoring case
+static const char *scan_text(LScan *scan) { return scan->folded ? scan->folded : scan_data(scan); }
+
+// Items that can match nothing, so the byte before them needn't be there
+static bool is_optional(char c) { return c == '*' || c == '?' || c == '-'; }
+
+static void needle_compile(Needle *n, const char *p, size_t lp, bool plain) {
+  *n = (Needle){.p = p, .lp = lp, .first = -1};
+  if (plain || pattern_is_plain(p, lp)) {
+    n->plain = true;
+    // Lines are matched on their own, so this could never match
+    if (memchr(p, '\n', lp) != NULL) n->searched = true;
+    return;
+  }
+  if (*p == '^') {
+    n->anchor = true;
+    n->p++;
+    n->lp--;
+    return;
+  }
+
+  // A literal first item lets candidates be found with memchr
+  int c = -1;
+  size_t item = 1;
+  if (p[0] == '%' && lp >= 2 && !isalnum((unsigned char)p[1])) {
+    c = (unsigned char)p[1];
+    item = 2;
+  } else if (p[0] != '\0' && strchr("^$*+?.([%-", p[0]) == NULL) {
+    c = (unsigned char)p[0];
+  }
+  if (c >= 0 && !(item < lp && is_optional(p[item]))) n->first = c;
+}
+
+// Tries `n` at exactly `s`, somewhere in [line, line_end)
+static bool needle_try(lua_State *L, Needle *n, const char *line, const char *line_end, const char *s) {
+  PatternState ms;
+  pattern_prepare(&ms, L, line, line_end - line, n->p, n->lp);
+  const char *e = pattern_match(&ms, s, n->p);
+  if (e == NULL) return false;
+  n->hit = s;
+  n->hit_end = e;
+  return true;
+}
+
+// Finds the first match of `n` in [from, end), `from` being the start of a line
+static void needle_search(lua_State *L, Needle *n, const char *from, const char *end) {
+  n->searched = true;
+  n->hit = NULL;
+
+  if (n->plain) {
+    const char *found = pattern_memfind(from, end - from, n->p, n->lp);
+    if (found != NULL) {
+      n->hit = found;
+      n->hit_end = found + n->lp;
+    }
+    return;
+  }
+
+  if (n->first >= 0) {
+    // The line of the last candidate is remembered, so finding each line's
+    // bounds never goes over the same bytes twice
+    const char *line = from;
+    const char *line_end = NULL;
+    const char *s = from;
+    const char *candidate;
+    while (s < end && (candidate = scan__memchr(s, n->first, end - s)) != NULL) {
+      if (line_end == NULL || candidate > line_end) {
+        const char *after = line_end ? line_end + 1 : from;
+        const char *nl = scan__memrchr(after, '\n', candidate - after);
+        line = nl ? nl + 1 : after;
+        nl = scan__memchr(candidate, '\n', end - candidate);
+        line_end = nl ? nl : end;
+      }
+      if (needle_try(L, n, line, line_end, candidate)) return;
+      s = candidate + 1;
+    }
+    return;
+  }
+
+  for (const char *line = from; line < end;) {
+    const char *nl = scan__memchr(line, '\n', end - line);
+    const char *line_end = nl ? nl : end;
+    const char *s = line;
+    do {
+      if (needle_try(L, n, line, line_end, s)) return;
+    } while (s++ < line_end && !n->anchor);
+    if (nl == NULL) break;
+    line = nl + 1;
+  }
+}
+
+// The pattern matching soonest after the scan's position, or NULL. When more
+// than one matches that line, the pattern given first wins, as in grep
+static Needle *scan_earliest(lua_State *L, LScan *scan, const char **line, const char **line_end) {
+  const char *text = scan_text(scan);
+  const char *from = text + scan->pos;
+  const char *end = text + scan->len;
+
+  Needle *first = NULL;
+  for (int i = 0; i < scan->count; i++) {
+    Needle *n = &scan->needles[i];
+    if (!n->searched || (n->hit != NULL && n->hit < from)) needle_search(L, n, from, end);
+    if (n->hit != NULL && (first == NULL || n->hit < first->hit)) first = n;
+  }
+  if (first == NULL) return NULL;
+
+  const char *nl = scan__memrchr(from, '\n', first->hit - from);
+  *line = nl ? nl + 1 : from;
+  nl = scan__memchr(first->hit, '\n', end - first->hit);
+  *line_end = nl ? nl : end;
+
+  for (int i = 0; i < scan->count; i++) {
+    Needle *n = &scan->needles[i];
+    if (n->hit != NULL && n->hit <= *line_end) return n;
+  }
+  return first;
+}
+
+// Appends a line number, first byte and last byte to the batch on top of the stack
+static void push_match(lua_State *L, LScan *scan, lua_Integer *n, lua_Integer first, lua_Integer last) {
+  lua_pushinteger(L, scan->line_no);
+  lua_rawseti(L, -2, ++*n);
+  lua_pushinteger(L, first);
+  lua_rawseti(L, -2, ++*n);
+  lua_pushinteger(L, last);
+  lua_rawseti(L, -2, ++*n);
+  if (scan->limit > 0) scan->limit--;
+}
+
+// Moves the scan on to the line after the one ending at `line_end`
+static void skip_line(LScan *scan, const char *line_end) {
+  const char *text = scan_text(scan);
+  scan->pos = line_end < text + scan->len ? (size_t)(line_end - text) + 1 : scan->len;
+  scan->line_no++;
+}
+
+static int lscan__next(lua_State *L) {
+  LScan *scan = check_scan(L);
+  lua_settop(L, 1);
+  const char *text = scan_text(scan);
+  const char *end = text + scan->len;
+
+  lua_newtable(L);
+  lua_Integer n = 0;
+  while (n < 3 * scan->batch && scan->limit != 0 && scan->pos < scan->len) {
+    const char *from = text + scan->pos;
+    const char *line = NULL, *line_end = NULL;
+    Needle *needle = scan_earliest(L, scan, &line, &line_end);
+
+    if (!scan->invert) {
+      if (needle == NULL) {
+        scan->pos = scan->len;
+        break;
+      }
+      scan->line_no += scan__count_byte(from, '\n', line - from);
+      push_match(L, scan, &n, needle->hit - text + 1, needle->hit_end - text);
+      skip_line(scan, line_end);
+      continue;
+    }
+
+    // Every line before the next match is reported whole, and the matching
+    // line skipped
+    const char *stop = needle ? line : end;
+    while (from < stop && n < 3 * scan->batch && scan->limit != 0) {
+      const char *nl = scan__memchr(from, '\n', stop - from);
+      const char *e = nl ? nl : stop;
+      push_match(L, scan, &n, from - text + 1, e - text);
+      skip_line(scan, e);
+      from = text + scan->pos;
+    }
+    if (needle != NULL && from == stop) skip_line(scan, line_end);
+  }
+
+  if (n == 0) lua_pushnil(L);
+  return 1;
+}
+
+// scan:batches(), for use in a generic for
+static int lscan__batches(lua_State *L) {
+  check_scan(L);
+  lua_pushcfunction(L, lscan__next);
+  lua_pushvalue(L, 1);
+  return 2;
+}
+
+// scan:line(i), the line holding byte `i` without its newline
+static int lscan__line(lua_State *L) {
+  LScan *scan = check_scan(L);
+  lua_Integer i = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, i >= 1 && i <= (lua_Integer)scan->len + 1, 2, "out of range");
+
+  const char *data = scan_data(scan);
+  size_t at = i - 1;
+  const char *nl = scan__memrchr(data, '\n', at);
+  const char *line = nl ? nl + 1 : data;
+  nl = scan__memchr(data + at, '\n', scan->len - at);
+  const char *line_end = nl ? nl : data + scan->len;
+  lua_pushlstring(L, line, line_end - line);
+  return 1;
+}
+
+// scan:sub(i, j), with the same relative positions as string.sub
+static int lscan__sub(lua_State *L) {
+  LScan *scan = check_scan(L);
+  lua_Integer len = scan->len;
+  lua_Integer i = luaL_checkinteger(L, 2);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+
+  if (i < 0) i = i < -len ? 1 : len + i + 1;
+  else if (i == 0) i = 1;
+  if (j < 0) j = j < -len ? 0 : len + j + 1;
+  else if (j > len) j = len;
+
+  if (i > j) lua_pushliteral(L, "");
+  else lua_pushlstring(L, scan_data(scan) + i - 1, j - i + 1);
+  return 1;
+}
+
+static int lscan__close(lua_State *L) {
+  LScan *scan = luaL_checkudata(L, 1, SCAN_METATABLE);
+  if (!scan->closed) file__unmap(scan->data, scan->len);
+  free(scan->folded);
+  scan->data = NULL;
+  scan->folded = NULL;
+  scan->closed = true;
+  return 0;
+}
+
+static const luaL_Reg scan_methods[] = {
+  {"next", lscan__next},
+  {"batches", lscan__batches},
+  {"line", lscan__line},
+  {"sub", lscan__sub},
+  {"close", lscan__close},
+  {"__gc", lscan__close},
+  {"__close", lscan__close},
+  {NULL, NULL},
+};
+
+// Pushes `p` lowercased, except for what follows each '%' so classes like %S
+// keep their meaning
+static void push_folded(lua_State *L, const char *p, size_t lp, bool plain) {
+  luaL_Buffer b;
+  char *out = luaL_buffinitsize(L, &b, lp);
+  for (size_t i = 0; i < lp; i++) {
+    if (!plain && p[i] == '%' && i + 1 < lp) {
+      out[i] = p[i];
+      i++;
+      out[i] = p[i];
+      continue;
+    }
+    out[i] = tolower((unsigned char)p[i]);
+  }
+  luaL_pushresultsize(&b, lp);
+}
+
+/**
+ * @@ search.scan(target: number | string, pattern: string | string[], opts?: {
+ *   plain: boolean, ignore_case: boolean, invert: boolean, max_count: number, batch: number
+ * }) -> (scan: Search_Scan | nil, err: number | nil)
+ *
+ * scan:next(), scan:batches(), scan:line(i), scan:sub(i, j), scan:close()
+ */
+int lsearch__scan(lua_State *L) {
+  lua_settop(L, 3);
+  int target_type = lua_type(L, 1);
+  luaL_argexpected(L, target_type == LUA_TNUMBER || target_type == LUA_TSTRING, 1, "fd or path");
+
+  int count = 1;
+  if (lua_istable(L, 2)) count = luaL_len(L, 2);
+  else luaL_checkstring(L, 2);
+
+  bool plain = false, ignore_case = false, invert = false;
+  lua_Integer batch = DEFAULT_BATCH, limit = -1;
+  if (lua_istable(L, 3)) {
+    lua_getfield(L, 3, "plain");
+    plain = lua_toboolean(L, -1);
+    lua_getfield(L, 3, "ignore_case");
+    ignore_case = lua_toboolean(L, -1);
+    lua_getfield(L, 3, "invert");
+    invert = lua_toboolean(L, -1);
+    lua_getfield(L, 3, "max_count");
+    if (!lua_isnil(L, -1)) limit = luaL_checkinteger(L, -1);
+    lua_getfield(L, 3, "batch");
+    if (!lua_isnil(L, -1)) batch = luaL_checkinteger(L, -1);
+    lua_pop(L, 5);
+    luaL_argcheck(L, batch > 0, 3, "batch must be positive");
+    if (limit < 0) limit = -1;
+  }
+
+  // Made before mapping, so a failed allocation can't leak the mapping
+  LScan *scan = lua_newuserdatauv(L, sizeof(*scan) + count * sizeof(Needle), 1);
+  *scan = (LScan){.closed = true, .invert = invert, .batch = batch, .limit = limit, .line_no = 1, .count = count};
+  if (luaL_newmetatable(L, SCAN_METATABLE)) {
+    luaL_setfuncs(L, scan_methods, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+  }
+  lua_setmetatable(L, -2);
+
+  // The patterns are kept in the user value so the needles can point into them
+  lua_createtable(L, count, 0);
+  for (int i = 0; i < count; i++) {
+    if (lua_istable(L, 2)) {
+      if (lua_geti(L, 2, i + 1) != LUA_TSTRING) return luaL_error(L, "pattern %d is not a string", i + 1);
+    } else {
+      lua_pushvalue(L, 2);
+    }
+    if (ignore_case) {
+      size_t lp;
+      const char *p = lua_tolstring(L, -1, &lp);
+      push_folded(L, p, lp, plain);
+      lua_remove(L, -2);
+    }
+    size_t lp;
+    const char *p = lua_tolstring(L, -1, &lp);
+    lua_rawseti(L, -2, i + 1);
+    needle_compile(&scan->needles[i], p, lp, plain);
+  }
+  lua_setiuservalue(L, -2, 1);
+
+  Error err;
+  size_t len;
+  const char *data;
+  if (target_type == LUA_TNUMBER) {
+    data = file__map_fd(luaL_checkinteger(L, 1), &len, &err);
+  } else {
+    char *fpath = fake_path(lua_tostring(L, 1));
+    if (fpath == NULL) {
+      lua_pushnil(L);
+      lua_pushnumber(L, E_DOESNTEXIST);
+      return 2;
+    }
+    data = file__map(fpath, &len, &err);
+    free(fpath);
+  }
+  if (err != 0) {
+    lua_pushnil(L);
+    lua_pushnumber(L, err);
+    return 2;
+  }
+  scan->data = data;
+  scan->len = len;
+  scan->closed = false;
+
+  if (ignore_case && len > 0) {
+    scan->folded = malloc(len);
+    if (scan->folded == NULL) return luaL_error(L, "not enough memory");
+    for (size_t i = 0; i < len; i++) scan->folded[i] = tolower((unsigned char)data[i]);
+  }
+
+  lua_pushnil(L);
+  return 2;
+}
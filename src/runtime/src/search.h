@@ -0,0 +1,8 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <lua.h>
+
+int lsearch__scan(lua_State *L);
+
+#endif
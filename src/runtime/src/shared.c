@@ -1,5 +1,6 @@
 #include "shared.h"
 #include "lauxlib.h"
+#include <limits.h>
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -261,70 +262,118 @@ int normalise_path_into_char_stack(char_stack *restrict stack, char **restrict a
   return 0;
 }
 
-char *fake_path(const char *path) {
-#ifndef __EMSCRIPTEN__
-  // Tests run natively, but return is still expected to be owned
-  // (sorry for strdup :( )
-  return strdup(path);
-#endif
+// Appends the components of `src` onto the path in `out`, resolving "." and
+// ".." as it goes. ".." never climbs above the first `root_len` bytes.
+// Returns the new length or -1 if it would not fit in PATH_MAX
+static int append_components(char *restrict out, int len, int root_len, const char *restrict src) {
+  const char *p = src;
+  while (*p != '\0') {
+    if (*p == '/') {
+      p++;
+      continue;
+    }
 
-  // Create stack
-  char_stack *stack = char_stack_create(4);
+    const char *end = p;
+    while (*end != '\0' && *end != '/') end++;
+    int n = end - p;
+
+    if (n == 2 && p[0] == '.' && p[1] == '.') {
+      // Back up over the last component and its separator
+      while (len > root_len && out[len - 1] != '/') len--;
+      if (len > root_len) len--;
+    } else if (!(n == 1 && p[0] == '.')) {
+      if (len + 1 + n >= PATH_MAX) return -1;
+      out[len++] = '/';
+      memcpy(out + len, p, n);
+      len += n;
+    }
+    p = end;
+  }
+  return len;
+}
 
-  // If it's a relative path, fill the stack with the CWD first
+int normalise_path(const char *restrict cwd, const char *restrict path, char *restrict out) {
+  const int root_len = FALSE_ROOT_SIZE;
+  memcpy(out, FALSE_ROOT, root_len);
+  int len = root_len;
+
+  // Relative paths start from the CWD, which already carries FALSE_ROOT
   if (*path != '/') {
-    Error err;
-    char *cwd = file__cwd(&err);
-    if (cwd == NULL) {
-      char_stack_free(stack);
-      return NULL;
-    }
+    if (strncmp(cwd, FALSE_ROOT, root_len) == 0) cwd += root_len;
+    len = append_components(out, len, root_len, cwd);
+    if (len < 0) return -1;
+  }
 
-    // Trim FALSE_ROOT from the start of CWD
-    const int shift = FALSE_ROOT_SIZE;
-    const int cwd_length = strlen(cwd) + 1;
-    memmove(cwd, cwd + shift, cwd_length - shift);
+  len = append_components(out, len, root_len, path);
+  if (len < 0) return -1;
 
-    if (*cwd != '\0') {
-      char **split_array = split(cwd, '/');
-      free(cwd);
-      if (split_array == NULL) {
-        char_stack_free(stack);
-        return NULL;
-      }
-      int ret = normalise_path_into_char_stack(stack, split_array);
-      free_char_array(split_array);
-      if (ret) {
-        char_stack_free(stack);
-        return NULL;
+  // The root itself keeps its trailing slash
+  if (len == root_len) out[len++] = '/';
+  out[len] = '\0';
+  return len;
+}
+
+// Recently resolved paths, only valid for the CWD they were resolved in
+typedef struct {
+  unsigned long last_used; // 0 if the entry is empty
+  char input[PATH_CACHE_ENTRY_MAX];
+  char resolved[PATH_CACHE_ENTRY_MAX];
+} path_cache_entry;
+
+static path_cache_entry path_cache[PATH_CACHE_SIZE];
+static unsigned long path_cache_tick = 0;
+
+void path_cache_invalidate(void) {
+  memset(path_cache, 0, sizeof(path_cache));
+  path_cache_tick = 0;
+}
+
+int resolve_path(const char *restrict path, char *restrict out) {
+  int input_len = strlen(path);
+  bool cacheable = input_len < PATH_CACHE_ENTRY_MAX;
+
+  path_cache_entry *victim = &path_cache[0];
+  if (cacheable) {
+    for (int i = 0; i < PATH_CACHE_SIZE; i++) {
+      path_cache_entry *entry = &path_cache[i];
+      if (entry->last_used != 0 && strcmp(entry->input, path) == 0) {
+        entry->last_used = ++path_cache_tick;
+        int len = strlen(entry->resolved);
+        memcpy(out, entry->resolved, len + 1);
+        return len;
       }
+      if (entry->last_used < victim->last_used) victim = entry;
     }
   }
 
-  // Split the path
-  char **split_array = split(path, '/');
-  if (split_array == NULL) {
-    char_stack_free(stack);
-    return NULL;
-  }
-  int ret = normalise_path_into_char_stack(stack, split_array);
-  free_char_array(split_array);
-  if (ret) {
-    char_stack_free(stack);
-    return NULL;
+  // Only relative paths need the CWD
+  const char *cwd = "";
+  if (*path != '/') {
+    Error err;
+    cwd = file__cwd(&err);
+    if (cwd == NULL) return -1;
   }
 
-  // Join the remaining stack elements together with '/'
-  char *normalised_path = char_stack_join(stack, '/');
-  // normalised_path only fails if the stack is empty
-  // Set it to an empty string if this is the case
-
-  // Join the false root to the normalised path
-  char *fake_path = join_paths(FALSE_ROOT, normalised_path);
+  int len = normalise_path(cwd, path, out);
+  if (len < 0) return -1;
 
-  // Cleanup
-  free(normalised_path);
-  char_stack_free(stack);  
-  return fake_path;
+  // Evict the least recently used entry
+  if (cacheable && len < PATH_CACHE_ENTRY_MAX) {
+    memcpy(victim->input, path, input_len + 1);
+    memcpy(victim->resolved, out, len + 1);
+    victim->last_used = ++path_cache_tick;
+  }
+  return len;
 }
 
+char *fake_path(const char *path) {
+#ifndef __EMSCRIPTEN__
+  // Tests run natively, but return is still expected to be owned
+  // (sorry for strdup :( )
+  return strdup(path);
+#endif
+
+  char resolved[PATH_MAX];
+  if (resolve_path(path, resolved) < 0) return NULL;
+  return strdup(resolved);
+}
@@ -33,6 +33,22 @@ void char_stack_print(char_stack *stack);
 char *char_stack_join(char_stack *stack, const char delim);
 int normalise_path_into_char_stack(char_stack *stack, char **array);
 
+// Number of resolved paths remembered by resolve_path
+#define PATH_CACHE_SIZE 16
+// Paths this long or longer are resolved every time rather than cached
+#define PATH_CACHE_ENTRY_MAX 256
+
+// Lexically normalises `path` against `cwd` into `out`, a PATH_MAX buffer,
+// rooting the result at FALSE_ROOT. Never allocates.
+// Returns the length of the result or -1 if it does not fit
+int normalise_path(const char *restrict cwd, const char *restrict path, char *restrict out);
+
+// Like normalise_path against the current CWD, but served from a small LRU
+// cache. MUST call path_cache_invalidate when the CWD changes
+int resolve_path(const char *restrict path, char *restrict out);
+void path_cache_invalidate(void);
+
+// WARNING: Return value MUST be freed
 char *fake_path(const char *path);
 
 #endif
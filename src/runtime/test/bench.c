@@ -0,0 +1,412 @@
+#include <fcntl.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../filesystem/src/file.h"
+#include "../../filesystem/src/scan.h"
+#include "../src/lib.h"
+#include "../src/shared.h"
+
+// Benchmarks for the lua runtime's hot paths
+//
+// Built with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc so every C heap
+// request made by the runtime and filesystem library is counted, while lua
+// gets its own counting allocator. Volume is the sum of all requested sizes,
+// so a buffer that is allocated and then copied out of counts twice.
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static size_t c_volume = 0;
+static size_t c_allocs = 0;
+static size_t lua_volume = 0;
+
+void *__wrap_malloc(size_t size) {
+  c_volume += size;
+  c_allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  c_volume += n * size;
+  c_allocs++;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  c_volume += size;
+  c_allocs++;
+  return __real_realloc(ptr, size);
+}
+
+static void *counting_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud;
+  (void)osize;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  // Only count growth, lua shrinks and re-grows its own stacks constantly
+  if (ptr == NULL || nsize > osize) lua_volume += nsize;
+  return __real_realloc(ptr, nsize);
+}
+
+static lua_State *new_state(void) {
+  lua_State *L = lua_newstate(counting_alloc, NULL);
+  luaL_openlibs(L);
+  luaL_newlib(L, file_module);
+  lua_setglobal(L, "file");
+  luaL_newlib(L, search_module);
+  lua_setglobal(L, "search");
+  return L;
+}
+
+static void make_file(const char *path, size_t size) {
+  int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0) {
+    perror("open");
+    exit(1);
+  }
+  char block[CHUNK_SIZE];
+  memset(block, 'x', sizeof(block));
+  for (size_t done = 0; done < size;) {
+    size_t n = size - done < sizeof(block) ? size - done : sizeof(block);
+    if (write(fd, block, n) != (ssize_t)n) {
+      perror("write");
+      exit(1);
+    }
+    done += n;
+  }
+  close(fd);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// How file.read_all used to hand data to lua, through a ReadResult
+static int legacy_read_all(lua_State *L) {
+  int fd = luaL_checknumber(L, 1);
+  ReadResult rr;
+  Error err;
+  file__read_all(fd, &rr, &err);
+  if (err != 0) return luaL_error(L, "read failed: %d", err);
+  lua_pushlstring(L, rr.data, rr.size);
+  free(rr.data);
+  return 1;
+}
+
+static void run(const char *label, lua_State *L, const char *code, const char *path, size_t size) {
+  // Let the state settle so only the read itself is measured
+  lua_gc(L, LUA_GCCOLLECT);
+  c_volume = 0;
+  lua_volume = 0;
+
+  double start = now();
+  if (luaL_loadstring(L, code) != LUA_OK) goto fail;
+  lua_pushstring(L, path);
+  lua_pushinteger(L, size);
+  if (lua_pcall(L, 2, 1, 0) != LUA_OK) goto fail;
+  double elapsed = now() - start;
+
+  if ((size_t)lua_tointeger(L, -1) != size) {
+    fprintf(stderr, "%s: read %lld bytes, expected %zu\n", label, (long long)lua_tointeger(L, -1), size);
+    exit(1);
+  }
+  lua_pop(L, 1);
+
+  size_t total = c_volume + lua_volume;
+  printf("%-28s %6zu KiB  c %9zu KiB  lua %9zu KiB  total %5.2fx  %8.3f ms\n", label, size / 1024,
+         c_volume / 1024, lua_volume / 1024, (double)total / size, elapsed * 1e3);
+  return;
+
+fail:
+  fprintf(stderr, "%s: %s\n", label, lua_tostring(L, -1));
+  exit(1);
+}
+
+// How fake_path used to normalise, through split and a char_stack
+static char *legacy_normalise(const char *cwd, const char *path) {
+  char_stack *stack = char_stack_create(4);
+  if (*path != '/') {
+    char **split_array = split(cwd + FALSE_ROOT_SIZE, '/');
+    normalise_path_into_char_stack(stack, split_array);
+    free_char_array(split_array);
+  }
+  char **split_array = split(path, '/');
+  normalise_path_into_char_stack(stack, split_array);
+  free_char_array(split_array);
+  char *normalised = char_stack_join(stack, '/');
+  char *joined = join_paths(FALSE_ROOT, normalised);
+  free(normalised);
+  char_stack_free(stack);
+  return joined;
+}
+
+static void bench_paths(void) {
+  static const char *cwd = FALSE_ROOT "/home/user/projects";
+  static const char *paths[] = {
+    "notes.txt",
+    "../docs/./guide/../index.md",
+    "/bin/ls.lua",
+    "hako/src/runtime/src/shared.c",
+  };
+  static const int npaths = sizeof(paths) / sizeof(*paths);
+  static const int rounds = 200000;
+  char out[PATH_MAX];
+
+  // Both must agree before their speed means anything
+  for (int i = 0; i < npaths; i++) {
+    char *expected = legacy_normalise(cwd, paths[i]);
+    normalise_path(cwd, paths[i], out);
+    if (strcmp(expected, out) != 0) {
+      fprintf(stderr, "normalise_path('%s') gave '%s', expected '%s'\n", paths[i], out, expected);
+      exit(1);
+    }
+    free(expected);
+  }
+
+  c_allocs = 0;
+  double start = now();
+  for (int r = 0; r < rounds; r++) {
+    free(legacy_normalise(cwd, paths[r % npaths]));
+  }
+  double elapsed = now() - start;
+  printf("%-28s %8.1f ns/path  %5.1f allocs/path\n", "split + char_stack", elapsed * 1e9 / rounds,
+         (double)c_allocs / rounds);
+
+  c_allocs = 0;
+  start = now();
+  for (int r = 0; r < rounds; r++) {
+    normalise_path(cwd, paths[r % npaths], out);
+  }
+  elapsed = now() - start;
+  printf("%-28s %8.1f ns/path  %5.1f allocs/path\n", "normalise_path", elapsed * 1e9 / rounds,
+         (double)c_allocs / rounds);
+
+  // Against the real CWD, so the first lookup of each path pays for getcwd
+  path_cache_invalidate();
+  c_allocs = 0;
+  start = now();
+  for (int r = 0; r < rounds; r++) {
+    resolve_path(paths[r % npaths], out);
+  }
+  elapsed = now() - start;
+  printf("%-28s %8.1f ns/path  %5.1f allocs/path\n", "resolve_path (cached)", elapsed * 1e9 / rounds,
+         (double)c_allocs / rounds);
+}
+
+static void bench_reads(void) {
+  static const size_t sizes[] = {1 << 20, 64 << 20};
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/%d-bench-read", getpid());
+
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); i++) {
+    size_t size = sizes[i];
+    make_file(path, size);
+
+    lua_State *L = new_state();
+    lua_register(L, "legacy_read_all", legacy_read_all);
+
+    run("ReadResult + pushlstring", L,
+        "local fd = file.open((...), 'r')\n"
+        "local s = legacy_read_all(fd)\n"
+        "file.close(fd)\n"
+        "return #s", path, size);
+    run("file.read_all", L,
+        "local fd = file.open((...), 'r')\n"
+        "local s = file.read_all(fd)\n"
+        "file.close(fd)\n"
+        "return #s", path, size);
+    run("file.read", L,
+        "local fd = file.open((...), 'r')\n"
+        "local s = file.read(fd, select(2, ...))\n"
+        "file.close(fd)\n"
+        "return #s", path, size);
+
+    lua_close(L);
+  }
+
+  unlink(path);
+}
+
+// The best of a few passes over `size` bytes, printed as GiB/s. What was
+// found is printed so the scan can't be optimised away
+#define SCAN_ROUND(label, expr)                                                                         \
+  do {                                                                                                  \
+    double best = 0;                                                                                    \
+    size_t found = 0;                                                                                   \
+    for (int round = 0; round < 3; round++) {                                                           \
+      double start = now();                                                                             \
+      found = (size_t)(expr);                                                                           \
+      double elapsed = now() - start;                                                                   \
+      if (round == 0 || elapsed < best) best = elapsed;                                                 \
+    }                                                                                                   \
+    printf("%-28s %8.2f GiB/s  -> %zu\n", label, size / best / (1 << 30), found);                       \
+  } while (0)
+
+static void bench_scan(void) {
+  static const size_t size = 100 << 20;
+  char *text = malloc(size);
+  if (text == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  // 80 column lines of ordinary text, none of the bytes searched for below
+  // appear so every kernel has to cover the whole buffer
+  for (size_t i = 0; i < size; i++) {
+    text[i] = i % 81 == 80 ? '\n' : "lorem ipsum dolor sit amet "[i % 27];
+  }
+  static const char set[] = "\x01\x02\x03";
+
+  if (scan__memchr(text, 1, size) != scan__memchr_scalar(text, 1, size) ||
+      scan__memrchr(text, '\n', size) != scan__memrchr_scalar(text, '\n', size) ||
+      scan__count_byte(text, '\n', size) != scan__count_byte_scalar(text, '\n', size) ||
+      scan__find_any(text, size, set, 3) != scan__find_any_scalar(text, size, set, 3)) {
+    fprintf(stderr, "scan kernels disagree with their scalar versions\n");
+    exit(1);
+  }
+
+  SCAN_ROUND("memchr (libc)", memchr(text, 1, size) != NULL);
+  SCAN_ROUND("scan__memchr_scalar", scan__memchr_scalar(text, 1, size) != NULL);
+  SCAN_ROUND("scan__memchr", scan__memchr(text, 1, size) != NULL);
+  SCAN_ROUND("scan__memrchr_scalar", scan__memrchr_scalar(text, 1, size) != NULL);
+  SCAN_ROUND("scan__memrchr", scan__memrchr(text, 1, size) != NULL);
+  SCAN_ROUND("scan__count_byte_scalar", scan__count_byte_scalar(text, '\n', size));
+  SCAN_ROUND("scan__count_byte", scan__count_byte(text, '\n', size));
+  SCAN_ROUND("scan__find_any_scalar", scan__find_any_scalar(text, size, set, 3) != NULL);
+  SCAN_ROUND("scan__find_any", scan__find_any(text, size, set, 3) != NULL);
+
+  free(text);
+}
+
+// ls -l and find stat the same nodes again and again, every pass after the
+// first is answered by the metadata cache rather than the filesystem
+static void bench_stat(void) {
+  enum { nfiles = 100, rounds = 1000 };
+  char dir[] = "/tmp/bench-stat-XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    exit(1);
+  }
+  static char paths[nfiles][64];
+  for (int i = 0; i < nfiles; i++) {
+    snprintf(paths[i], sizeof(paths[i]), "%s/%d", dir, i);
+    make_file(paths[i], i);
+  }
+
+  struct stat st;
+  double start = now();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < nfiles; i++) stat(paths[i], &st);
+  }
+  double elapsed = now() - start;
+  printf("%-28s %8.1f ns/stat\n", "stat", elapsed * 1e9 / (rounds * nfiles));
+
+  StatResult sr;
+  Error err;
+  MetadataCacheStats before, after;
+  file__cache_stats(&before);
+  start = now();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < nfiles; i++) file__stat(paths[i], &sr, &err);
+  }
+  elapsed = now() - start;
+  file__cache_stats(&after);
+  unsigned long hits = after.hits - before.hits;
+  unsigned long lookups = hits + after.misses - before.misses;
+  printf("%-28s %8.1f ns/stat  %5.1f%% hits\n", "file__stat (cached)", elapsed * 1e9 / (rounds * nfiles),
+         100.0 * hits / lookups);
+
+  for (int i = 0; i < nfiles; i++) unlink(paths[i]);
+  rmdir(dir);
+}
+
+// Times one way of finding the matching lines, which has to agree with the others
+static void search_round(lua_State *L, const char *label, const char *code, const char *path, const char *pattern,
+                         size_t size, lua_Integer *matches) {
+  if (luaL_loadstring(L, code) != LUA_OK) goto fail;
+  lua_pushstring(L, path);
+  lua_pushstring(L, pattern);
+  double start = now();
+  if (lua_pcall(L, 2, 1, 0) != LUA_OK) goto fail;
+  double elapsed = now() - start;
+
+  lua_Integer found = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  if (*matches >= 0 && found != *matches) {
+    fprintf(stderr, "%s: found %lld lines, expected %lld\n", label, (long long)found, (long long)*matches);
+    exit(1);
+  }
+  *matches = found;
+  printf("%-28s %8.1f MiB/s  %-10s -> %lld lines\n", label, size / elapsed / (1 << 20), pattern, (long long)found);
+  return;
+
+fail:
+  fprintf(stderr, "%s: %s\n", label, lua_tostring(L, -1));
+  exit(1);
+}
+
+static void bench_search(void) {
+  static const size_t size = 32 << 20;
+  static const char *patterns[] = {"needle", "n%w+dle", "^needle"};
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/%d-bench-search", getpid());
+
+  // Source-like lines, one in a thousand holding the needle
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    perror("fopen");
+    exit(1);
+  }
+  for (size_t written = 0, line = 0; written < size; line++) {
+    int n = fprintf(f, line % 1000 == 999 ? "needle %zu\n" : "  local value_%zu = compute(value, %zu) -- a comment\n",
+                    line, line * 7);
+    written += n;
+  }
+  fclose(f);
+
+  lua_State *L = new_state();
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(*patterns); i++) {
+    lua_Integer matches = -1;
+    search_round(L, "map:lines + string.find",
+                 "local map, pattern = file.map((...)), select(2, ...)\n"
+                 "local count = 0\n"
+                 "for line in map:lines() do\n"
+                 "  if line:find(pattern) then count = count + 1 end\n"
+                 "end\n"
+                 "map:close()\n"
+                 "return count",
+                 path, patterns[i], size, &matches);
+    search_round(L, "search.scan",
+                 "local scan = search.scan(...)\n"
+                 "local count = 0\n"
+                 "for batch in scan:batches() do count = count + #batch // 3 end\n"
+                 "scan:close()\n"
+                 "return count",
+                 path, patterns[i], size, &matches);
+  }
+  lua_close(L);
+  unlink(path);
+}
+
+int main(void) {
+  bench_reads();
+  bench_paths();
+  bench_scan();
+  bench_search();
+  bench_stat();
+  return 0;
+}
@@ -1,4 +1,6 @@
 #include <fcntl.h>
+#include <limits.h>
+#include <string.h>
 #include <time.h>
 #include <lauxlib.h>
 #include <lua.h>
@@ -10,8 +12,10 @@
 #include <unity.h>
 #include <stdio.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "../src/lib.h"
+#include "../src/shared.h"
 
 lua_State *L = NULL;
 int unique_test_id = 0;
@@ -27,6 +31,8 @@ void setUp(void) {
   luaL_openlibs(L);
   luaL_newlib(L, file_module);
   lua_setglobal(L, "file");
+  luaL_newlib(L, search_module);
+  lua_setglobal(L, "search");
 }
 
 void tearDown(void) {
@@ -112,6 +118,91 @@ void test_file_write_and_read(void) {
   lua_settop(L, top);
 }
 
+void test_file_write_many(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Fragments are written in order and NUL bytes survive the round trip
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local fd, err = file.open('/tmp/%d-file-write-many', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local err = file.write(fd, 'a\\0b', '', 12, string.rep('c', 70000), '\\0')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.close(fd)\n"
+      "fd = file.open('/tmp/%d-file-write-many', 'r')\n"
+      "local res, err = file.read_all(fd)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if res ~= 'a\\0b12' .. string.rep('c', 70000) .. '\\0' then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "contents of file were not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_read_write_at(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local path = '/tmp/%d-file-read-write-at'\n"
+      "local fd, err = file.open(path, 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.write(fd, '0123456789')\n"
+      "file.jump(fd, 2)\n"
+      "if file.read_at(fd, 4, 3) ~= '456' or file.read_at(fd, 8, 10) ~= '89' or file.read_at(fd, 20, 5) ~= '' then\n"
+      "  return 'read_at'\n"
+      "end\n"
+      "err = file.write_at(fd, 3, 'abc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "err = file.write_at(fd, 12, 'end')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "-- Neither call moved the cursor\n"
+      "if file.read(fd, 3) ~= '2ab' then\n"
+      "  return 'cursor moved'\n"
+      "end\n"
+      "if file.read_at(fd, 0, 100) ~= '012abc6789\\0\\0end' then\n"
+      "  return 'contents'\n"
+      "end\n"
+      "file.close(fd)\n"
+      "if file.read_at(fd, 0, 1) ~= nil then\n"
+      "  return 'read from a closed fd'\n"
+      "end\n"
+      "file.remove(path)\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "positional io failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "contents of file were not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
 void test_file_read_all(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
@@ -131,304 +222,1328 @@ void test_file_read_all(void) {
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "return res", unique_test_id, unique_test_id);
+      "return res", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TSTRING, lua_type(L, -1), "expected to get string result");
+  TEST_ASSERT_EQUAL_STRING_MESSAGE("Hello, world", lua_tostring(L, -1), "Written contents are different from what is expected");
+
+  lua_settop(L, top);
+}
+
+void test_file_read_all_large(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Larger than a single read chunk, so the contents are streamed in pieces
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local fd, err = file.open('/tmp/%d-file-read-all-large', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local content = string.rep('0123456789', 20000)\n"
+      "local err = file.write(fd, content)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.close(fd)\n"
+      "fd = file.open('/tmp/%d-file-read-all-large', 'r')\n"
+      "local res, err = file.read_all(fd)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if res ~= content then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "contents of file were not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_read_line(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Reads in between lines must pick up where the last line ended
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local fd, err = file.open('/tmp/%d-file-read-line', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.write(fd, 'one\\ntwo\\n\\nlast')\n"
+      "file.close(fd)\n"
+      "fd = file.open('/tmp/%d-file-read-line', 'r')\n"
+      "local expected = { 'one', 'two', '', '', 'last' }\n"
+      "local got = {}\n"
+      "got[1] = file.read_line(fd)\n"
+      "got[2] = file.read(fd, 3)\n"
+      "for i = 3, 5 do\n"
+      "  local line, err = file.read_line(fd)\n"
+      "  if err ~= nil then\n"
+      "    return err\n"
+      "  end\n"
+      "  got[i] = line\n"
+      "end\n"
+      "local eof, err = file.read_line(fd)\n"
+      "file.close(fd)\n"
+      "if eof ~= nil or err ~= nil then\n"
+      "  return ''\n"
+      "end\n"
+      "for i = 1, #expected do\n"
+      "  if got[i] ~= expected[i] then\n"
+      "    return ''\n"
+      "  end\n"
+      "end\n"
+      "return 0", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "lines read were not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_map(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Every view method should agree with the string function it mirrors
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local path = '/tmp/%d-file-map'\n"
+      "local content = 'first line\\nsecond (2) line\\n\\nlast line without newline'\n"
+      "local fd, err = file.open(path, 'wc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.write(fd, content)\n"
+      "file.close(fd)\n"
+      "local map, err = file.map(path)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if #map ~= #content then\n"
+      "  return 'length'\n"
+      "end\n"
+      "for _, range in ipairs({ { 1, 5 }, { -9, -1 }, { 7 }, { 0, 3 }, { 5, 2 }, { -100, 100 } }) do\n"
+      "  if map:sub(range[1], range[2]) ~= content:sub(range[1], range[2]) then\n"
+      "    return 'sub'\n"
+      "  end\n"
+      "end\n"
+      "local checks = {\n"
+      "  { '(%%a+) %%((%%d)%%)' }, { 'line', 12 }, { '()newline$' }, { '(2)', 1, true },\n"
+      "  { '^first' }, { '^second' }, { 'missing' }, { '%%f[%%w]%%w+$' }, { '', 100 },\n"
+      "}\n"
+      "for _, check in ipairs(checks) do\n"
+      "  local expected = table.pack(content:find(check[1], check[2], check[3]))\n"
+      "  local found = table.pack(map:find(check[1], check[2], check[3]))\n"
+      "  if found.n ~= expected.n then\n"
+      "    return 'find ' .. check[1]\n"
+      "  end\n"
+      "  for i = 1, found.n do\n"
+      "    if found[i] ~= expected[i] then\n"
+      "      return 'find ' .. check[1]\n"
+      "    end\n"
+      "  end\n"
+      "end\n"
+      "local lines = {}\n"
+      "for line in map:lines() do\n"
+      "  lines[#lines + 1] = line\n"
+      "end\n"
+      "if table.concat(lines, '|') ~= 'first line|second (2) line||last line without newline' then\n"
+      "  return 'lines'\n"
+      "end\n"
+      "map:close()\n"
+      "if pcall(map.sub, map, 1, 1) then\n"
+      "  return 'used after close'\n"
+      "end\n"
+      "fd = file.open(path, 'w')\n"
+      "file.truncate(fd, 0)\n"
+      "file.close(fd)\n"
+      "map, err = file.map(path)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if #map ~= 0 or map:sub(1) ~= '' or map:find('') ~= 1 or map:lines()() ~= nil then\n"
+      "  return 'empty'\n"
+      "end\n"
+      "map:close()\n"
+      "file.remove(path)\n"
+      "local _, missing = file.map(path)\n"
+      "if missing == nil then\n"
+      "  return 'mapped a missing file'\n"
+      "end\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "map disagreed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "map disagreed with its file");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_count_lines(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Lengths either side of every vector width, and long enough to wrap a lane counter
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local seed = 7\n"
+      "local function text(len)\n"
+      "  local bytes = {}\n"
+      "  for i = 1, len do\n"
+      "    seed = (seed * 1103515245 + 12345) %% 2147483648\n"
+      "    bytes[i] = string.sub('abcdefghij\\n,;:\\t xy', seed %% 19 + 1, seed %% 19 + 1)\n"
+      "  end\n"
+      "  return table.concat(bytes)\n"
+      "end\n"
+      "\n"
+      "local function expected(s)\n"
+      "  local newlines = select(2, s:gsub('\\n', ''))\n"
+      "  return newlines + ((#s > 0 and s:sub(-1) ~= '\\n') and 1 or 0)\n"
+      "end\n"
+      "for len = 0, 100 do\n"
+      "  local s = text(len)\n"
+      "  if file.count_lines(s) ~= expected(s) then\n"
+      "    return ''\n"
+      "  end\n"
+      "end\n"
+      "local long = string.rep('\\n', 70000) .. text(1000)\n"
+      "if file.count_lines(long) ~= expected(long) then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0");
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "count_lines disagreed with gsub");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_index_of(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Every start position, for sets small enough to compare in vectors and not
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local seed = 7\n"
+      "local function text(len)\n"
+      "  local bytes = {}\n"
+      "  for i = 1, len do\n"
+      "    seed = (seed * 1103515245 + 12345) %% 2147483648\n"
+      "    bytes[i] = string.sub('abcdefghij\\n,;:\\t xy', seed %% 19 + 1, seed %% 19 + 1)\n"
+      "  end\n"
+      "  return table.concat(bytes)\n"
+      "end\n"
+      "\n"
+      "local sets = { '\\n', 'xy', ',;:\\t', 'abcdefghij' }\n"
+      "for len = 0, 80, 3 do\n"
+      "  local s = text(len)\n"
+      "  for _, set in ipairs(sets) do\n"
+      "    local class = '[' .. set:gsub('%%p', '%%%%%%0') .. ']'\n"
+      "    for init = -len - 1, len + 1 do\n"
+      "      if file.index_of(s, set, init) ~= s:find(class, init) then\n"
+      "        return ''\n"
+      "      end\n"
+      "    end\n"
+      "  end\n"
+      "end\n"
+      "if file.index_of('abc', '') ~= nil then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0");
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "index_of disagreed with string.find");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_shift(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local fd, err = file.open('/tmp/%d-file-shift', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local err = file.write(fd, 'Hello, world')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.close(fd)\n"
+      "fd = file.open('/tmp/%d-file-shift', 'r')\n"
+      "file.shift(fd, 3)\n"
+      "local res, err = file.read_all(fd)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "return res", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TSTRING, lua_type(L, -1), "expected to get string result");
+  TEST_ASSERT_EQUAL_STRING_MESSAGE("lo, world", lua_tostring(L, -1), "Written contents are different from what is expected");
+
+  lua_settop(L, top);
+}
+
+void test_file_jump(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local fd, err = file.open('/tmp/%d-file-goto', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local err = file.write(fd, 'Hello, world')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.close(fd)\n"
+      "fd = file.open('/tmp/%d-file-goto', 'r')\n"
+      "local err = file.jump(fd, 5)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local res, err = file.read_all(fd)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "return res", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TSTRING, lua_type(L, -1), "expected to get string result");
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(", world", lua_tostring(L, -1), "Written contents are different from what is expected");
+
+  lua_settop(L, top);
+}
+
+void test_file_remove(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local fd, err = file.open('/tmp/%d-file-remove', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.close(fd)\n"
+      "local err = file.remove('/tmp/%d-file-remove')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "return 0", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-remove", unique_test_id);
+
+  // Check that the file does not exist
+  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) != 0, "Expected file to not exist");
+
+  lua_settop(L, top);
+}
+
+void test_file_replace_contents(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local dir = '/tmp/%d-file-replace-contents'\n"
+      "local err = file.make_dir(dir)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local path = dir .. '/notes.txt'\n"
+      "local fd = file.open(path, 'wc')\n"
+      "file.write(fd, 'a much longer original line')\n"
+      "file.close(fd)\n"
+      "local before = file.stat(path).perm\n"
+      "\n"
+      "local function contents(p)\n"
+      "  local fd = file.open(p, 'r')\n"
+      "  local text = file.read_all(fd)\n"
+      "  file.close(fd)\n"
+      "  return text\n"
+      "end\n"
+      "\n"
+      "err = file.replace_contents(path, 'short')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if contents(path) ~= 'short' then\n"
+      "  return 'contents'\n"
+      "end\n"
+      "if file.stat(path).perm ~= before then\n"
+      "  return 'permissions'\n"
+      "end\n"
+      "\n"
+      "err = file.replace_contents(dir .. '/new.txt', 'new\\0bytes')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if contents(dir .. '/new.txt') ~= 'new\\0bytes' then\n"
+      "  return 'created contents'\n"
+      "end\n"
+      "\n"
+      "file.permit(path, 'r')\n"
+      "if file.replace_contents(path, 'x') == nil or contents(path) ~= 'short' then\n"
+      "  return 'replaced a read-only file'\n"
+      "end\n"
+      "if file.replace_contents(dir, 'x') == nil then\n"
+      "  return 'replaced a directory'\n"
+      "end\n"
+      "\n"
+      "-- Nothing is left behind beside the files\n"
+      "local names = {}\n"
+      "for _, name in ipairs(file.read_dir(dir)) do\n"
+      "  if name ~= '.' and name ~= '..' then\n"
+      "    names[#names + 1] = name\n"
+      "  end\n"
+      "end\n"
+      "table.sort(names)\n"
+      "if table.concat(names, ' ') ~= 'new.txt notes.txt' then\n"
+      "  return 'left ' .. table.concat(names, ' ')\n"
+      "end\n"
+      "file.permit(path, 'rw')\n"
+      "file.remove_tree(dir)\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "replace_contents failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "contents of file were not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_replace_contents_symlink(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  char dir[64], target[96], link[96];
+  snprintf(dir, sizeof(dir), "/tmp/%d-file-replace-symlink", unique_test_id);
+  snprintf(target, sizeof(target), "%s/target.txt", dir);
+  snprintf(link, sizeof(link), "%s/link.txt", dir);
+  TEST_ASSERT_EQUAL_INT(0, mkdir(dir, 0700));
+  FILE *f = fopen(target, "w");
+  TEST_ASSERT_MESSAGE(f != NULL, "Failed to create the link target");
+  fputs("old", f);
+  fclose(f);
+  TEST_ASSERT_EQUAL_INT(0, symlink("target.txt", link));
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local err = file.replace_contents('%s', 'new')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local fd = file.open('%s', 'r')\n"
+      "local text = file.read_all(fd)\n"
+      "file.close(fd)\n"
+      "if text ~= 'new' then\n"
+      "  return 'target contents'\n"
+      "end\n"
+      "return 0", link, target);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "replace_contents failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "contents of file were not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  // The link is still a link, to the same file
+  TEST_ASSERT_EQUAL_INT(0, lstat(link, &sb));
+  TEST_ASSERT_MESSAGE(S_ISLNK(sb.st_mode), "symlink was replaced by a regular file");
+
+  unlink(link);
+  unlink(target);
+  rmdir(dir);
+  lua_settop(L, top);
+}
+
+void test_file_move(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local fd, err = file.open('/tmp/%d-file-move0', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.close(fd)\n"
+      "local err = file.move('/tmp/%d-file-move0', '/tmp/%d-file-move1')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "return 0", unique_test_id, unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-move0", unique_test_id);
+
+  // Check that the file does not exist
+  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) != 0, "Expected file to not exist");
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-move1", unique_test_id);
+
+  // Check that the file does exist
+  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) == 0, "Expected file to exist");
+
+  lua_settop(L, top);
+}
+
+void test_file_make_dir(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local err = file.make_dir('/tmp/%d-file-make-dir')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-make-dir", unique_test_id);
+
+  // Check that the file does exist
+  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) == 0, "Expected directory to exist");
+  TEST_ASSERT_MESSAGE(S_ISDIR(sb.st_mode) != 0, "Expected it to be a directory");
+
+  lua_settop(L, top);
+}
+
+void test_file_remove_dir(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local err = file.make_dir('/tmp/%d-file-remove-dir')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "err = file.remove_dir('/tmp/%d-file-remove-dir')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "return 0", unique_test_id, unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-remove-dir", unique_test_id);
+
+  // Check that the file does exist
+  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) != 0, "Expected directory not to exist");
+
+  lua_settop(L, top);
+}
+
+void test_file_change_dir(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local err = file.change_dir('/tmp')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local fd, err = file.open('%d-file-change-dir', 'rwc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.close(fd)\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-change-dir", unique_test_id);
+
+  // Check that the file does exist
+  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) == 0, "Expected file to exist");
+
+  lua_settop(L, top);
+}
+
+void test_file_read_dir(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local entries, err = file.read_dir('/tmp')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if #entries == 0 then\n"
+      " return ''\n"
+      "end\n"
+      "return 0");
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "Expected read_dir to return some entries when reading /tmp");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_read_dir_stat(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Each entry comes back with the same stat a separate file.stat gives
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local dir = '/tmp/%d-file-read-dir-stat'\n"
+      "local err = file.make_dir(dir)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local fd, err = file.open(dir .. '/a', 'wc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.write(fd, 'Hello')\n"
+      "file.close(fd)\n"
+      "file.make_dir(dir .. '/b')\n"
+      "local entries, err = file.read_dir(dir, { stat = true })\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local seen = 0\n"
+      "for _, entry in ipairs(entries) do\n"
+      "  local st = file.stat(dir .. '/' .. entry.name)\n"
+      "  if entry.stat.ino ~= st.ino or entry.stat.type ~= st.type or entry.stat.size ~= st.size then\n"
+      "    return ''\n"
+      "  end\n"
+      "  if entry.name == 'a' or entry.name == 'b' then\n"
+      "    seen = seen + 1\n"
+      "  end\n"
+      "end\n"
+      "file.remove(dir .. '/a')\n"
+      "file.remove_dir(dir .. '/b')\n"
+      "file.remove_dir(dir)\n"
+      "if seen ~= 2 then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "entries did not match their stats");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
+void test_file_read_dir_stat_vanished(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // A dangling link is listed but fails to stat, just like an entry removed
+  // between reading the directory and stat'ing it
+  char dir[64], kept[96], gone[96];
+  snprintf(dir, sizeof(dir), "/tmp/%d-file-read-dir-vanished", unique_test_id);
+  snprintf(kept, sizeof(kept), "%s/kept", dir);
+  snprintf(gone, sizeof(gone), "%s/gone", dir);
+  TEST_ASSERT_EQUAL_INT(0, mkdir(dir, 0700));
+  TEST_ASSERT_EQUAL_INT(0, mkdir(kept, 0700));
+  TEST_ASSERT_EQUAL_INT(0, symlink("nowhere", gone));
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local entries, err = file.read_dir('%s', { stat = true })\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local found = {}\n"
+      "for _, entry in ipairs(entries) do\n"
+      "  found[entry.name] = entry\n"
+      "end\n"
+      "if not found.kept or not found.kept.stat or found.kept.stat.type ~= 1 then\n"
+      "  return 'kept'\n"
+      "end\n"
+      "if not found.gone or found.gone.stat ~= nil then\n"
+      "  return 'gone'\n"
+      "end\n"
+      "return 0", dir);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "read_dir with stat failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "entries were not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  unlink(gone);
+  rmdir(kept);
+  rmdir(dir);
+  lua_settop(L, top);
+}
+
+void test_file_walk(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // root/a, root/b/c, root/b/d/e and root/skip/f
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local root = '/tmp/%d-file-walk'\n"
+      "for _, dir in ipairs({ '', '/b', '/b/d', '/skip' }) do\n"
+      "  local err = file.make_dir(root .. dir)\n"
+      "  if err ~= nil then\n"
+      "    return err\n"
+      "  end\n"
+      "end\n"
+      "for _, path in ipairs({ '/a', '/b/c', '/b/d/e', '/skip/f' }) do\n"
+      "  local fd, err = file.open(root .. path, 'wc')\n"
+      "  if err ~= nil then\n"
+      "    return err\n"
+      "  end\n"
+      "  file.close(fd)\n"
+      "end\n"
+      "local function collect(opts)\n"
+      "  local seen = {}\n"
+      "  for path, stat, depth in file.walk(root, opts) do\n"
+      "    seen[#seen + 1] = string.format('%%s:%%d:%%d', path:sub(#root + 1), stat.type, depth)\n"
+      "  end\n"
+      "  table.sort(seen)\n"
+      "  return table.concat(seen, ' ')\n"
+      "end\n"
+      "local all = collect()\n"
+      "local shallow = collect({ max_depth = 1 })\n"
+      "local files = collect({ type = 0 })\n"
+      "local pruned = collect({ prune = function(path) return path:sub(-5) == '/skip' end })\n"
+      "for path, stat in file.walk(root) do\n"
+      "  break\n"
+      "end\n"
+      "local _, missing = file.walk(root .. '/nope')\n"
+      "for _, path in ipairs({ '/a', '/b/c', '/b/d/e', '/skip/f' }) do\n"
+      "  file.remove(root .. path)\n"
+      "end\n"
+      "for _, dir in ipairs({ '/b/d', '/b', '/skip', '' }) do\n"
+      "  file.remove_dir(root .. dir)\n"
+      "end\n"
+      "if all ~= '/a:0:1 /b/c:0:2 /b/d/e:0:3 /b/d:1:2 /b:1:1 /skip/f:0:2 /skip:1:1 :1:0' then\n"
+      "  return 'all: ' .. all\n"
+      "end\n"
+      "if shallow ~= '/a:0:1 /b:1:1 /skip:1:1 :1:0' then\n"
+      "  return 'shallow: ' .. shallow\n"
+      "end\n"
+      "if files ~= '/a:0:1 /b/c:0:2 /b/d/e:0:3 /skip/f:0:2' then\n"
+      "  return 'files: ' .. files\n"
+      "end\n"
+      "if pruned ~= '/a:0:1 /b/c:0:2 /b/d/e:0:3 /b/d:1:2 /b:1:1 /skip:1:1 :1:0' then\n"
+      "  return 'pruned: ' .. pruned\n"
+      "end\n"
+      "if missing == nil then\n"
+      "  return 'walking a missing path gave no error'\n"
+      "end\n"
+      "return 0", unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TSTRING, lua_type(L, -1), "expected to get string result");
-  TEST_ASSERT_EQUAL_STRING_MESSAGE("Hello, world", lua_tostring(L, -1), "Written contents are different from what is expected");
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "unexpected walk, %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "walk visited the wrong nodes");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
   lua_settop(L, top);
 }
 
-void test_file_shift(void) {
+void test_file_walk_resilient(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
+  // root/f1..f6 and root/sub/up, a link back to root
+  char root[64], path[128];
+  snprintf(root, sizeof(root), "/tmp/%d-file-walk-resilient", unique_test_id);
+  TEST_ASSERT_EQUAL_INT(0, mkdir(root, 0700));
+  snprintf(path, sizeof(path), "%s/sub", root);
+  TEST_ASSERT_EQUAL_INT(0, mkdir(path, 0700));
+  snprintf(path, sizeof(path), "%s/sub/up", root);
+  TEST_ASSERT_EQUAL_INT(0, symlink("..", path));
+  for (int i = 1; i <= 6; i++) {
+    snprintf(path, sizeof(path), "%s/f%d", root, i);
+    FILE *f = fopen(path, "w");
+    TEST_ASSERT_MESSAGE(f != NULL, "Failed to create a file to walk");
+    fclose(f);
+  }
+
+  // The first file seen removes its siblings, which the walk has already
+  // listed, so they fail to stat when their turn comes
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local fd, err = file.open('/tmp/%d-file-shift', 'rwc')\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "local root = '%s'\n"
+      "local removed, failed, total, up = false, 0, 0, nil\n"
+      "for path, stat, depth, err in file.walk(root) do\n"
+      "  total = total + 1\n"
+      "  if total > 100 then\n"
+      "    return 'walk did not end'\n"
+      "  end\n"
+      "  local name = path:match('[^/]*$')\n"
+      "  if err ~= nil then\n"
+      "    if stat ~= nil then\n"
+      "      return 'stat alongside an error'\n"
+      "    end\n"
+      "    failed = failed + 1\n"
+      "  elseif depth == 1 and name:sub(1, 1) == 'f' and not removed then\n"
+      "    removed = true\n"
+      "    for i = 1, 6 do\n"
+      "      if root .. '/f' .. i ~= path then\n"
+      "        file.remove(root .. '/f' .. i)\n"
+      "      end\n"
+      "    end\n"
+      "  end\n"
+      "  if name == 'up' then\n"
+      "    up = stat\n"
+      "  end\n"
+      "  if path:find('/up/', 1, true) then\n"
+      "    return 'the link to an ancestor was followed'\n"
+      "  end\n"
       "end\n"
-      "local err = file.write(fd, 'Hello, world')\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "if up == nil or up.type ~= 1 then\n"
+      "  return 'the link was not reported as its target'\n"
       "end\n"
-      "file.close(fd)\n"
-      "fd = file.open('/tmp/%d-file-shift', 'r')\n"
-      "file.shift(fd, 3)\n"
-      "local res, err = file.read_all(fd)\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "if failed == 0 then\n"
+      "  return 'no removed entries were reported'\n"
       "end\n"
-      "return res", unique_test_id, unique_test_id);
+      "return 0", root);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TSTRING, lua_type(L, -1), "expected to get string result");
-  TEST_ASSERT_EQUAL_STRING_MESSAGE("lo, world", lua_tostring(L, -1), "Written contents are different from what is expected");
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "unexpected walk, %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "walk didn't carry on past failing nodes");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
+  for (int i = 1; i <= 6; i++) {
+    snprintf(path, sizeof(path), "%s/f%d", root, i);
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s/sub/up", root);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/sub", root);
+  rmdir(path);
+  rmdir(root);
   lua_settop(L, top);
 }
 
-void test_file_jump(void) {
+void test_file_copy(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local fd, err = file.open('/tmp/%d-file-goto', 'rwc')\n"
+      "local src = '/tmp/%d-file-copy-src'\n"
+      "local dst = src .. '-dst'\n"
+      "-- Spans several chunks, and overwrites a longer existing file\n"
+      "local content = string.rep('0123456789', 20000) .. 'end'\n"
+      "local fd, err = file.open(src, 'wc')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "local err = file.write(fd, 'Hello, world')\n"
+      "file.write(fd, content)\n"
+      "file.close(fd)\n"
+      "fd, err = file.open(dst, 'wc')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
+      "file.write(fd, content .. content)\n"
       "file.close(fd)\n"
-      "fd = file.open('/tmp/%d-file-goto', 'r')\n"
-      "local err = file.jump(fd, 5)\n"
+      "err = file.copy(src, dst)\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "local res, err = file.read_all(fd)\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "local same = file.copy(src, src)\n"
+      "fd = file.open(dst, 'r')\n"
+      "local copied = file.read_all(fd)\n"
+      "file.close(fd)\n"
+      "file.remove(src)\n"
+      "file.remove(dst)\n"
+      "if copied ~= content then\n"
+      "  return ''\n"
       "end\n"
-      "return res", unique_test_id, unique_test_id);
+      "if same == nil then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0", unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TSTRING, lua_type(L, -1), "expected to get string result");
-  TEST_ASSERT_EQUAL_STRING_MESSAGE(", world", lua_tostring(L, -1), "Written contents are different from what is expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "copy did not match its source");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
   lua_settop(L, top);
 }
 
-void test_file_remove(void) {
+void test_file_copy_tree(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local fd, err = file.open('/tmp/%d-file-remove', 'rwc')\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "local src = '/tmp/%d-file-copy-tree'\n"
+      "for _, dir in ipairs({ '', '/b', '/b/d' }) do\n"
+      "  local err = file.make_dir(src .. dir)\n"
+      "  if err ~= nil then\n"
+      "    return err\n"
+      "  end\n"
       "end\n"
-      "file.close(fd)\n"
-      "local err = file.remove('/tmp/%d-file-remove')\n"
+      "for _, path in ipairs({ '/a', '/b/c', '/b/d/e' }) do\n"
+      "  local fd, err = file.open(src .. path, 'wc')\n"
+      "  if err ~= nil then\n"
+      "    return err\n"
+      "  end\n"
+      "  file.write(fd, path)\n"
+      "  file.close(fd)\n"
+      "end\n"
+      "-- Copying into the source itself must not recurse into the copy\n"
+      "local err = file.copy_tree(src, src .. '/b/copy')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "return 0", unique_test_id, unique_test_id);
+      "local seen = {}\n"
+      "for path, stat in file.walk(src .. '/b/copy') do\n"
+      "  if stat.type == 0 then\n"
+      "    local fd = file.open(path, 'r')\n"
+      "    local rel = path:sub(#src + 8)\n"
+      "    if file.read_all(fd) ~= rel then\n"
+      "      return ''\n"
+      "    end\n"
+      "    file.close(fd)\n"
+      "    seen[#seen + 1] = rel\n"
+      "  end\n"
+      "end\n"
+      "file.remove_tree(src)\n"
+      "table.sort(seen)\n"
+      "if table.concat(seen, ' ') ~= '/a /b/c /b/d/e' then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0", unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "copied tree did not match its source");
   TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
-  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-remove", unique_test_id);
-
-  // Check that the file does not exist
-  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) != 0, "Expected file to not exist");
-
   lua_settop(L, top);
 }
 
-void test_file_move(void) {
+void test_file_remove_tree(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local fd, err = file.open('/tmp/%d-file-move0', 'rwc')\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "local root = '/tmp/%d-file-remove-tree'\n"
+      "for _, dir in ipairs({ '', '/b', '/b/d' }) do\n"
+      "  local err = file.make_dir(root .. dir)\n"
+      "  if err ~= nil then\n"
+      "    return err\n"
+      "  end\n"
       "end\n"
-      "file.close(fd)\n"
-      "local err = file.move('/tmp/%d-file-move0', '/tmp/%d-file-move1')\n"
+      "for _, path in ipairs({ '/a', '/b/c', '/b/d/e' }) do\n"
+      "  local fd, err = file.open(root .. path, 'wc')\n"
+      "  if err ~= nil then\n"
+      "    return err\n"
+      "  end\n"
+      "  file.close(fd)\n"
+      "end\n"
+      "local err = file.remove_tree(root)\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "return 0", unique_test_id, unique_test_id, unique_test_id);
+      "if file.stat(root) ~= nil then\n"
+      "  return ''\n"
+      "end\n"
+      "if file.remove_tree(root) == nil then\n"
+      "  return ''\n"
+      "end\n"
+      "return 0", unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "tree was not removed");
   TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
-  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-move0", unique_test_id);
-
-  // Check that the file does not exist
-  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) != 0, "Expected file to not exist");
-
-  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-move1", unique_test_id);
-
-  // Check that the file does exist
-  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) == 0, "Expected file to exist");
-
   lua_settop(L, top);
 }
 
-void test_file_make_dir(void) {
+void test_file_tree_partial(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
+  // root/f1..f6 and root/locked, a system file that can't be read
+  char root[64], dst[96], locked[96];
+  snprintf(root, sizeof(root), "/tmp/%d-file-tree-partial", unique_test_id);
+  snprintf(dst, sizeof(dst), "%s-copy", root);
+  snprintf(locked, sizeof(locked), "%s/locked", root);
+  TEST_ASSERT_EQUAL_INT(0, mkdir(root, 0700));
+  for (int i = 1; i <= 6; i++) {
+    char path[96];
+    snprintf(path, sizeof(path), "%s/f%d", root, i);
+    FILE *f = fopen(path, "w");
+    TEST_ASSERT_MESSAGE(f != NULL, "Failed to create a file in the tree");
+    fclose(f);
+  }
+  FILE *f = fopen(locked, "w");
+  TEST_ASSERT_MESSAGE(f != NULL, "Failed to create the system file");
+  fclose(f);
+  TEST_ASSERT_EQUAL_INT(0, chmod(locked, 0310));
+
+  // Both must get past the failing node to every sibling, wherever it's listed
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local err = file.make_dir('/tmp/%d-file-make-dir')\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "local root, dst = '%s', '%s'\n"
+      "if file.copy_tree(root, dst) == nil then\n"
+      "  return 'copy did not report the unreadable file'\n"
       "end\n"
-      "return 0", unique_test_id);
+      "for i = 1, 6 do\n"
+      "  if file.stat(dst .. '/f' .. i) == nil then\n"
+      "    return 'copy stopped before f' .. i\n"
+      "  end\n"
+      "end\n"
+      "file.remove_tree(dst)\n"
+      "if file.remove_tree(root) == nil then\n"
+      "  return 'remove did not report the system file'\n"
+      "end\n"
+      "for i = 1, 6 do\n"
+      "  if file.stat(root .. '/f' .. i) ~= nil then\n"
+      "    return 'remove stopped before f' .. i\n"
+      "  end\n"
+      "end\n"
+      "if file.stat(root .. '/locked') == nil then\n"
+      "  return 'the system file was removed'\n"
+      "end\n"
+      "return 0", root, dst);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "unexpected tree, %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "a failing node stopped its siblings");
   TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
-  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-make-dir", unique_test_id);
-
-  // Check that the file does exist
-  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) == 0, "Expected directory to exist");
-  TEST_ASSERT_MESSAGE(S_ISDIR(sb.st_mode) != 0, "Expected it to be a directory");
-
+  unlink(locked);
+  rmdir(root);
   lua_settop(L, top);
 }
 
-void test_file_remove_dir(void) {
+void test_file_stat(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local err = file.make_dir('/tmp/%d-file-remove-dir')\n"
+      "local fd, err = file.open('/tmp/%d-file-stat', 'wc')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "err = file.remove_dir('/tmp/%d-file-remove-dir')\n"
+      "err = file.write(fd, 'Hello, world')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
+      "err = file.close(fd)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "local st, err = file.stat('/tmp/%d-file-stat')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if st.size ~= 12 then\n"
+      "  return ''\n"
+      "end\n"
+      "_ = st.blocksize\n"
+      "_ = st.ino\n"
+      "_ = st.perm\n"
+      "_ = st.atime.sec\n"
+      "_ = st.atime.nsec\n"
+      "_ = st.mtime.sec\n"
+      "_ = st.mtime.nsec\n"
+      "_ = st.ctime.sec\n"
+      "_ = st.ctime.nsec\n"
       "return 0", unique_test_id, unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "the size reported by file.stat is incorrect");
   TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
-  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-remove-dir", unique_test_id);
-
-  // Check that the file does exist
-  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) != 0, "Expected directory not to exist");
-
   lua_settop(L, top);
 }
 
-void test_file_change_dir(void) {
+void test_file_reserve(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local err = file.change_dir('/tmp')\n"
+      "local path = '/tmp/%d-file-reserve'\n"
+      "local fd, err = file.open(path, 'rwc')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "local fd, err = file.open('%d-file-change-dir', 'rwc')\n"
+      "err = file.reserve(fd, 65536)\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
+      "if file.fdstat(fd).size ~= 0 then\n"
+      "  return 'reserve changed the size'\n"
+      "end\n"
+      "for i = 1, 100 do\n"
+      "  file.write(fd, string.rep('x', 100))\n"
+      "end\n"
+      "if file.fdstat(fd).size ~= 10000 then\n"
+      "  return 'size after writes'\n"
+      "end\n"
+      "-- Smaller than the file, nothing to do\n"
+      "if file.reserve(fd, 10) ~= nil or file.fdstat(fd).size ~= 10000 then\n"
+      "  return 'small reserve'\n"
+      "end\n"
+      "if file.truncate(fd, 10000) ~= nil or file.truncate(fd, 5) ~= nil then\n"
+      "  return 'truncate'\n"
+      "end\n"
+      "if file.read_at(fd, 0, 100) ~= 'xxxxx' then\n"
+      "  return 'contents'\n"
+      "end\n"
       "file.close(fd)\n"
+      "if file.reserve(fd, 100) == nil then\n"
+      "  return 'reserved a closed fd'\n"
+      "end\n"
+      "file.remove(path)\n"
       "return 0", unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "expected to get integer result");
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "reserve failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "file was not as expected");
   TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
-  snprintf(static_fmt_buf, STATIC_FMT_SIZE, "/tmp/%d-file-change-dir", unique_test_id);
-
-  // Check that the file does exist
-  TEST_ASSERT_MESSAGE(stat(static_fmt_buf, &sb) == 0, "Expected file to exist");
-
   lua_settop(L, top);
 }
 
-void test_file_read_dir(void) {
+void test_file_large_offsets(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local entries, err = file.read_dir('/tmp')\n"
+      "local path = '/tmp/%d-file-large'\n"
+      "local fd, err = file.open(path, 'rwc')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "if #entries == 0 then\n"
-      " return ''\n"
+      "-- Every offset here is past what 32 bits can hold, the file stays sparse\n"
+      "local gib = 1 << 30\n"
+      "err = file.truncate(fd, 3 * gib)\n"
+      "if err ~= nil then\n"
+      "  return err\n"
       "end\n"
-      "return 0");
+      "if file.fdstat(fd).size ~= 3 * gib then\n"
+      "  return 'truncate size'\n"
+      "end\n"
+      "err = file.write_at(fd, 5 * gib, 'tail')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "if file.fdstat(fd).size ~= 5 * gib + 4 or file.read_at(fd, 5 * gib, 10) ~= 'tail' then\n"
+      "  return 'write_at'\n"
+      "end\n"
+      "if file.read_at(fd, 4 * gib, 2) ~= '\\0\\0' then\n"
+      "  return 'hole'\n"
+      "end\n"
+      "file.jump(fd, 5 * gib + 1)\n"
+      "file.shift(fd, -1)\n"
+      "-- More than is left, only what's there is read\n"
+      "if file.read(fd, 4 * gib) ~= 'tail' then\n"
+      "  return 'jump and read'\n"
+      "end\n"
+      "err = file.truncate(fd, 2 * gib + 2)\n"
+      "if err ~= nil or file.fdstat(fd).size ~= 2 * gib + 2 then\n"
+      "  return 'truncate down'\n"
+      "end\n"
+      "file.close(fd)\n"
+      "return 0", unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "Expected read_dir to return some entries when reading /tmp");
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "large offsets failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "file was not as expected");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+  lua_settop(L, top);
+
+  // Timestamps past 2038 (2100-01-01 here) have to survive too
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/%d-file-large", unique_test_id);
+  struct timespec times[2] = {{.tv_sec = 4102444800}, {.tv_sec = 4102444800}};
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, utimensat(AT_FDCWD, path, times, 0), "couldn't set the file's times");
+
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local path = '/tmp/%d-file-large'\n"
+      "local st = file.stat(path)\n"
+      "file.remove(path)\n"
+      "if st.mtime.sec ~= 4102444800 then\n"
+      "  return 'mtime ' .. tostring(st.mtime.sec)\n"
+      "end\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "large offsets failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "stat was not as expected");
   TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
   lua_settop(L, top);
 }
 
-void test_file_stat(void) {
+void test_file_cache_stats(void) {
   TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
   int top = lua_gettop(L);
 
   snprintf(static_fmt_buf, STATIC_FMT_SIZE,
-      "local fd, err = file.open('/tmp/%d-file-stat', 'wc')\n"
+      "local dir = '/tmp/%d-file-cache'\n"
+      "local err = file.make_dir(dir)\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "err = file.write(fd, 'Hello, world')\n"
+      "local path = dir .. '/a'\n"
+      "local fd\n"
+      "fd, err = file.open(path, 'wc')\n"
       "if err ~= nil then\n"
       "  return err\n"
       "end\n"
-      "err = file.close(fd)\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "file.write(fd, 'abc')\n"
+      "local before = file.cache_stats()\n"
+      "if file.stat(path).size ~= 3 or file.stat(path).size ~= 3 then\n"
+      "  return 'stat'\n"
       "end\n"
-      "local st, err = file.stat('/tmp/%d-file-stat')\n"
-      "if err ~= nil then\n"
-      "  return err\n"
+      "local after = file.cache_stats()\n"
+      "if after.hits - before.hits ~= 1 or after.misses - before.misses ~= 1 or after.entries < 1 then\n"
+      "  return 'counters'\n"
       "end\n"
-      "if st.size ~= 12 then\n"
-      "  return ''\n"
+      "-- Writing drops what was cached\n"
+      "file.write(fd, 'def')\n"
+      "if file.stat(path).size ~= 6 then\n"
+      "  return 'stale after write'\n"
       "end\n"
-      "_ = st.blocksize\n"
-      "_ = st.ino\n"
-      "_ = st.perm\n"
-      "_ = st.atime.sec\n"
-      "_ = st.atime.nsec\n"
-      "_ = st.mtime.sec\n"
-      "_ = st.mtime.nsec\n"
-      "_ = st.ctime.sec\n"
-      "_ = st.ctime.nsec\n"
-      "return 0", unique_test_id, unique_test_id);
+      "file.close(fd)\n"
+      "-- Listing with stats fills the cache for what was listed\n"
+      "file.read_dir(dir, { stat = true })\n"
+      "before = file.cache_stats()\n"
+      "file.stat(path)\n"
+      "if file.cache_stats().hits - before.hits ~= 1 then\n"
+      "  return 'listing not cached'\n"
+      "end\n"
+      "file.remove(path)\n"
+      "if file.stat(path) ~= nil then\n"
+      "  return 'stale after remove'\n"
+      "end\n"
+      "file.remove_dir(dir)\n"
+      "return 0", unique_test_id);
   if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
     const char *err = lua_tostring(L, -1);
     fprintf(stderr, "lua code failed to run: %s\n", err);
     TEST_FAIL();
   }
-  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "the size reported by file.stat is incorrect");
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "metadata cache failed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "cache was not as expected");
   TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
 
   lua_settop(L, top);
@@ -548,23 +1663,233 @@ void test_file_truncate(void) {
   lua_settop(L, top);
 }
 
+void test_normalise_path(void) {
+  const struct {
+    const char *cwd;
+    const char *path;
+    const char *expected;
+  } cases[] = {
+    {"/persistent", "/", "/persistent/"},
+    {"/persistent", "/../../etc", "/persistent/etc"},       // .. stops at the root
+    {"/persistent/home", "../../..", "/persistent/"},
+    {"/persistent/home", ".", "/persistent/home"},
+    {"/persistent", "/a/./b/.", "/persistent/a/b"},
+    {"/persistent", "//a///b", "/persistent/a/b"},          // repeated slashes
+    {"/persistent", "/a/b/", "/persistent/a/b"},            // trailing slash
+    {"/persistent/home", "docs/../notes.txt", "/persistent/home/notes.txt"},
+    {"/persistent/home/", "./docs//", "/persistent/home/docs"},
+    {"/tmp", "x", "/persistent/tmp/x"},                     // CWD outside the root
+  };
+
+  char out[PATH_MAX];
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    int len = normalise_path(cases[i].cwd, cases[i].path, out);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(cases[i].expected, out, cases[i].path);
+    TEST_ASSERT_EQUAL_INT_MESSAGE((int)strlen(cases[i].expected), len, cases[i].path);
+  }
+
+  // A result that doesn't fit in PATH_MAX fails rather than being cut short
+  static char long_path[PATH_MAX + 2];
+  long_path[0] = '/';
+  memset(long_path + 1, 'a', PATH_MAX);
+  long_path[PATH_MAX + 1] = '\0';
+  TEST_ASSERT_EQUAL_INT(-1, normalise_path("/persistent", long_path, out));
+  TEST_ASSERT_EQUAL_INT(-1, normalise_path(long_path, "a", out));
+}
+
+void test_path_cache_change_dir(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  char saved[PATH_MAX], first[64], second[64];
+  TEST_ASSERT_MESSAGE(getcwd(saved, sizeof(saved)) != NULL, "Failed to get the CWD");
+  snprintf(first, sizeof(first), "/tmp/%d-path-cache-a", unique_test_id);
+  snprintf(second, sizeof(second), "/tmp/%d-path-cache-b", unique_test_id);
+  TEST_ASSERT_EQUAL_INT(0, mkdir(first, 0700));
+  TEST_ASSERT_EQUAL_INT(0, mkdir(second, 0700));
+
+  // The same relative path resolves against each new CWD, not from the cache
+  const char *dirs[] = {first, second};
+  char cwd[PATH_MAX], out[PATH_MAX], expected[PATH_MAX + 32];
+  for (int i = 0; i < 2; i++) {
+    snprintf(static_fmt_buf, STATIC_FMT_SIZE, "return file.change_dir('%s')", dirs[i]);
+    TEST_ASSERT_EQUAL_INT(LUA_OK, luaL_dostring(L, static_fmt_buf));
+    TEST_ASSERT_MESSAGE(lua_isnil(L, -1), "change_dir returned an error");
+    lua_pop(L, 1);
+
+    TEST_ASSERT_MESSAGE(getcwd(cwd, sizeof(cwd)) != NULL, "Failed to get the CWD");
+    snprintf(expected, sizeof(expected), "/persistent%s/notes.txt", cwd);
+    TEST_ASSERT_MESSAGE(resolve_path("notes.txt", out) > 0, "resolve_path failed");
+    TEST_ASSERT_EQUAL_STRING(expected, out);
+  }
+
+  TEST_ASSERT_EQUAL_INT(0, chdir(saved));
+  path_cache_invalidate();
+  rmdir(first);
+  rmdir(second);
+  lua_settop(L, top);
+}
+
+void test_search_scan(void) {
+  TEST_ASSERT_MESSAGE(L != NULL, "Lua is not initialized properly");
+  int top = lua_gettop(L);
+
+  // Every pattern kind, batch size and option should report what string.find does line by line
+  snprintf(static_fmt_buf, STATIC_FMT_SIZE,
+      "local path = '/tmp/%d-search-scan'\n"
+      "local content = 'local x = 1\\n\\nfunction foo(a, b)\\n  return a + b\\nend\\nFOO bar (foo)\\n-- last line without newline'\n"
+      "local fd, err = file.open(path, 'wc')\n"
+      "if err ~= nil then\n"
+      "  return err\n"
+      "end\n"
+      "file.write(fd, content)\n"
+      "file.close(fd)\n"
+      "\n"
+      "local lines = {}\n"
+      "for line in (content .. '\\n'):gmatch('([^\\n]*)\\n') do\n"
+      "  lines[#lines + 1] = line\n"
+      "end\n"
+      "\n"
+      "-- What grep would report, from string.find on each line\n"
+      "local function expected(patterns, opts)\n"
+      "  local out = {}\n"
+      "  local pos = 1\n"
+      "  for no, line in ipairs(lines) do\n"
+      "    local subject = opts.ignore_case and line:lower() or line\n"
+      "    local s, e\n"
+      "    for _, p in ipairs(patterns) do\n"
+      "      s, e = subject:find(opts.ignore_case and p:lower() or p, 1, opts.plain)\n"
+      "      if s then\n"
+      "        break\n"
+      "      end\n"
+      "    end\n"
+      "    if opts.invert and not s then\n"
+      "      table.insert(out, no .. ':' .. pos .. ':' .. (pos + #line - 1))\n"
+      "    elseif not opts.invert and s then\n"
+      "      table.insert(out, no .. ':' .. (pos + s - 1) .. ':' .. (pos + e - 1))\n"
+      "    end\n"
+      "    if #out == opts.max_count then\n"
+      "      break\n"
+      "    end\n"
+      "    pos = pos + #line + 1\n"
+      "  end\n"
+      "  return table.concat(out, ' ')\n"
+      "end\n"
+      "\n"
+      "local function scanned(target, patterns, opts)\n"
+      "  local scan, err = search.scan(target, patterns, opts)\n"
+      "  if err ~= nil then\n"
+      "    return 'error ' .. err\n"
+      "  end\n"
+      "  local out = {}\n"
+      "  for batch in scan:batches() do\n"
+      "    for i = 1, #batch, 3 do\n"
+      "      if scan:line(batch[i + 1]) ~= lines[batch[i]] then\n"
+      "        return 'line'\n"
+      "      end\n"
+      "      table.insert(out, batch[i] .. ':' .. batch[i + 1] .. ':' .. batch[i + 2])\n"
+      "    end\n"
+      "  end\n"
+      "  scan:close()\n"
+      "  return table.concat(out, ' ')\n"
+      "end\n"
+      "\n"
+      "local cases = {\n"
+      "  { { 'foo' } }, { { 'foo' }, { ignore_case = true } }, { { 'a + b' }, { plain = true } },\n"
+      "  { { '^end' } }, { { '%%w+%%(' } }, { { 'f%%a*' } }, { { '%%(f' } }, { { 'o+' } }, { { 'x?y*$' } },\n"
+      "  { { '^$' } }, { { '' } }, { { 'bar', 'foo' } }, { { 'zzz', '^%%s' } }, { { 'return' }, { invert = true } },\n"
+      "  { { 'o' }, { max_count = 2 } }, { { 'o' }, { invert = true, max_count = 3 } }, { { 'zzz' } },\n"
+      "  { { 'b\\nend' } }, { { 'newline' }, { invert = true } },\n"
+      "}\n"
+      "for i, case in ipairs(cases) do\n"
+      "  local opts = case[2] or {}\n"
+      "  for _, batch in ipairs({ 1, 2, 256 }) do\n"
+      "    opts.batch = batch\n"
+      "    local want = expected(case[1], opts)\n"
+      "    local got = scanned(path, case[1], opts)\n"
+      "    if got ~= want then\n"
+      "      return 'case ' .. i .. ': ' .. got .. ' ~= ' .. want\n"
+      "    end\n"
+      "  end\n"
+      "end\n"
+      "\n"
+      "fd = file.open(path, 'r')\n"
+      "file.read(fd, 5)\n"
+      "if scanned(fd, 'foo') ~= expected({ 'foo' }, {}) then\n"
+      "  return 'fd'\n"
+      "end\n"
+      "file.close(fd)\n"
+      "\n"
+      "local scan = search.scan(path, 'FOO bar')\n"
+      "local batch = scan:next()\n"
+      "if scan:sub(batch[2], batch[3]) ~= 'FOO bar' or scan:next() ~= nil then\n"
+      "  return 'sub'\n"
+      "end\n"
+      "scan:close()\n"
+      "if pcall(scan.next, scan) then\n"
+      "  return 'used after close'\n"
+      "end\n"
+      "\n"
+      "file.remove(path)\n"
+      "local _, missing = search.scan(path, 'foo')\n"
+      "if missing == nil then\n"
+      "  return 'scanned a missing file'\n"
+      "end\n"
+      "return 0", unique_test_id);
+  if (LUA_OK != luaL_dostring(L, static_fmt_buf)) {
+    const char *err = lua_tostring(L, -1);
+    fprintf(stderr, "lua code failed to run: %s\n", err);
+    TEST_FAIL();
+  }
+  if (lua_type(L, -1) == LUA_TSTRING) {
+    fprintf(stderr, "scan disagreed on %s\n", lua_tostring(L, -1));
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LUA_TNUMBER, lua_type(L, -1), "scan disagreed with string.find");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, lua_tonumber(L, -1), "api function returned an error code");
+
+  lua_settop(L, top);
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_file_open);
   RUN_TEST(test_file_close);
   RUN_TEST(test_file_write_and_read);
+  RUN_TEST(test_file_write_many);
+  RUN_TEST(test_file_read_write_at);
   RUN_TEST(test_file_read_all);
+  RUN_TEST(test_file_read_all_large);
+  RUN_TEST(test_file_read_line);
+  RUN_TEST(test_file_map);
+  RUN_TEST(test_file_count_lines);
+  RUN_TEST(test_file_index_of);
   RUN_TEST(test_file_shift);
   RUN_TEST(test_file_jump);
   RUN_TEST(test_file_remove);
+  RUN_TEST(test_file_replace_contents);
+  RUN_TEST(test_file_replace_contents_symlink);
   RUN_TEST(test_file_move);
   RUN_TEST(test_file_make_dir);
   RUN_TEST(test_file_remove_dir);
   RUN_TEST(test_file_change_dir);
   RUN_TEST(test_file_read_dir);
+  RUN_TEST(test_file_read_dir_stat);
+  RUN_TEST(test_file_read_dir_stat_vanished);
+  RUN_TEST(test_file_walk);
+  RUN_TEST(test_file_walk_resilient);
+  RUN_TEST(test_file_copy);
+  RUN_TEST(test_file_copy_tree);
+  RUN_TEST(test_file_remove_tree);
+  RUN_TEST(test_file_tree_partial);
   RUN_TEST(test_file_stat);
   RUN_TEST(test_file_fdstat);
+  RUN_TEST(test_file_reserve);
+  RUN_TEST(test_file_large_offsets);
+  RUN_TEST(test_file_cache_stats);
   RUN_TEST(test_file_permit);
   RUN_TEST(test_file_truncate);
+  RUN_TEST(test_search_scan);
+  RUN_TEST(test_normalise_path);
+  RUN_TEST(test_path_cache_change_dir);
   return UNITY_END();
 }
@@ -77,3 +77,10 @@ interface Stat {
 }
 
 type StatResult = { error: null, stat: Stat } | { error: FilesystemError, stat: null };
+
+interface DirEntry {
+  name: string,
+  stat: Stat | null, // null if the entry couldn't be stat'ed
+}
+
+type ReadDirPlusResult = { error: null, entries: DirEntry[] } | { error: FilesystemError, entries: null };
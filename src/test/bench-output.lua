@@ -0,0 +1,54 @@
+-- Throughput of process.output when stdout is redirected to a file, under
+-- each process.output_buffering policy.
+-- Run with `npm run bench` from src/.
+
+local COUNT = 100000
+
+local child = [[
+local mode = process.argv[2]
+errors.ok(process.output_buffering(mode))
+
+local start = os.clock()
+for i = 1, %d do
+  output(i)
+end
+process.close_output()
+local elapsed = os.clock() - start
+
+local fd, err = file.open("/bench-output-" .. mode .. ".time", "wc")
+errors.ok(err)
+file.write(fd, tostring(elapsed))
+file.close(fd)
+]]
+
+local fd, err = file.open("/bench-output-child.lua", "wc")
+errors.ok(err)
+errors.ok(file.write(fd, string.format(child, COUNT)))
+file.close(fd)
+
+for _, mode in ipairs({ "none", "line", "full" }) do
+  local pid, err = process.create("/bench-output-child.lua", {
+    argv = { "/bench-output-child.lua", mode },
+    redirect_out = "/bench-output-" .. mode .. ".txt",
+  })
+  errors.ok(err)
+  process.start(pid)
+  local status = process.wait(pid)
+  if status ~= 0 then
+    error(string.format("benchmark child for '%s' exited with %d", mode, status))
+  end
+
+  fd, err = file.open("/bench-output-" .. mode .. ".time", "r")
+  errors.ok(err)
+  local elapsed = tonumber(file.read_all(fd))
+  file.close(fd)
+
+  local stat = file.stat("/bench-output-" .. mode .. ".txt")
+  output(string.format("%-5s %d outputs, %d bytes in %8.2f ms (%10.0f outputs/s)",
+    mode, COUNT, stat.size, elapsed * 1e3, COUNT / elapsed))
+
+  file.remove("/bench-output-" .. mode .. ".txt")
+  file.remove("/bench-output-" .. mode .. ".time")
+end
+
+file.remove("/bench-output-child.lua")
@@ -107,6 +107,92 @@ test("Pipes", function ()
   unwrap("file.remove", "/return")
 end)
 
+test("Binary pipes", function ()
+  local bytes = {}
+  for i = 0, 255 do bytes[#bytes + 1] = string.char(255 - i) end
+  local data = table.concat(bytes):rep(16)
+
+  local writer_src = [[
+    local bytes = {}
+    for i = 0, 255 do bytes[#bytes + 1] = string.char(255 - i) end
+    process.output_bytes(table.concat(bytes):rep(16))
+    process.close_output()
+  ]]
+
+  local reader_src = [[
+    local chunks = {}
+    while true do
+      local chunk, err = process.input_bytes(100)
+      if err ~= nil then
+        output(err)
+        error("reader failed")
+      end
+      if chunk == "" then break end
+      chunks[#chunks + 1] = chunk
+    end
+    local fd = file.open("/return", "wc")
+    file.write(fd, table.concat(chunks))
+    file.close(fd)
+  ]]
+
+  ensure_file("/pipe-bytes-writer.lua", writer_src)
+  ensure_file("/pipe-bytes-reader.lua", reader_src)
+
+  local wtr = unwrap("process.create", "/pipe-bytes-writer.lua", { pipe_in = true, pipe_out = true })
+  local rdr = unwrap("process.create", "/pipe-bytes-reader.lua", { pipe_in = true, pipe_out = false })
+
+  unwrap("process.pipe", wtr, rdr)
+  unwrap("process.start", rdr)
+  unwrap("process.start", wtr)
+  unwrap("process.wait", rdr)
+
+  check(data == filedata("/return"), "Reader got different bytes than were written")
+  unwrap("file.remove", "/return")
+end)
+
+test("Heap pipes", function ()
+  -- The writer's stdout lives in its own memory and is written from C, the
+  -- reader takes it through a JS Pipe. A small pipe makes the ring wrap
+  local writer_src = [[
+    for i = 0, 255 do
+      process.output_bytes(string.char(i):rep(i + 1))
+    end
+    process.close_output()
+  ]]
+
+  local reader_src = [[
+    local chunks = {}
+    while true do
+      local chunk, err = process.input_bytes(1000)
+      if err ~= nil then
+        output(err)
+        error("reader failed")
+      end
+      if chunk == "" then break end
+      chunks[#chunks + 1] = chunk
+    end
+    local fd = file.open("/return", "wc")
+    file.write(fd, table.concat(chunks))
+    file.close(fd)
+  ]]
+
+  ensure_file("/pipe-heap-writer.lua", writer_src)
+  ensure_file("/pipe-heap-reader.lua", reader_src)
+
+  local wtr = unwrap("process.create", "/pipe-heap-writer.lua", { pipe_in = true, pipe_out = true, heap_pipe = true, pipe_size = 64 })
+  local rdr = unwrap("process.create", "/pipe-heap-reader.lua", { pipe_in = true, pipe_out = false })
+
+  unwrap("process.pipe", wtr, rdr)
+  unwrap("process.start", rdr)
+  unwrap("process.start", wtr)
+  unwrap("process.wait", rdr)
+
+  local expected = {}
+  for i = 0, 255 do expected[#expected + 1] = string.char(i):rep(i + 1) end
+  check(table.concat(expected) == filedata("/return"), "Reader got different bytes than were written")
+  unwrap("file.remove", "/return")
+end)
+
 test("File does not exist", function()
   local fd, err = file.open("/thisdoesnotexist", "")
   check(err ~= nil, "expected file.open to error")